@@ -1,121 +1,211 @@
 #pragma once
 #include <string>
+#include <cstdint>
+#include <fstream>
 #include <functional>
 #include <utility>
-#include <vector>
 #include <optional>
+#include <sstream>
 #include "my-bpt/BPT.h"
+#include "my-bpt/paged_array.h"
+#include "my-bpt/disk/wal.h"
 
 
 using hash_t = RFlowey::hash_t;
 
+struct BloomStats {
+  size_t queries;
+  size_t negatives;//answered without the tree
+  size_t false_positives;//passed the filter, then missed in the tree; lookups of erased keys count here too
+
+  [[nodiscard]] double false_positive_rate() const {
+    return negatives + false_positives == 0 ? 0 : double(false_positives) / double(negatives + false_positives);
+  }
+};
+
+/**
+ * Blocked Bloom filter: a key sets NumHashFunctions bits inside a single 512-bit block,
+ * so a lookup touches one cache line. Sized from the expected key count, kept as raw 64-bit words.
+ * Erased keys keep their bits, clear() is the only way to drop them.
+ * Blocks live in one new[] array, which honours the 64-byte alignment.
+ */
 template<
   typename T,
   typename PrimaryHasher,
-  size_t NumHashFunctions = 3, // Number of hash functions
-  size_t BitArraySize = 1024 * 8 // Size of the bit array (e.g., 1KB)
+  size_t NumHashFunctions = 6
 >
 class BloomFilter {
+  static_assert(NumHashFunctions > 0 && NumHashFunctions * 9 <= 64, "probes are 9-bit slices of one hash");
+
+  struct alignas(64) Block {
+    std::uint64_t words[8];
+  };
+
+  struct Header {
+    std::uint64_t blocks;
+    std::uint64_t added;
+  };
 
 public:
-  BloomFilter() : bits_(BitArraySize, false), filepath_(""), primary_hasher_() {
+  using Stats = BloomStats;
+
+  explicit BloomFilter(size_t expected_keys = RFlowey::BLOOM_EXPECTED_KEYS)
+    : block_count_(block_count(expected_keys)), blocks_(new Block[block_count_]()), primary_hasher_() {
   }
 
-  explicit BloomFilter(std::string filepath)
-    : bits_(BitArraySize, false), filepath_(std::move(filepath)), primary_hasher_() {
+  // The file is kept under the WAL like the trees, a checkpoint writes it back
+  BloomFilter(std::string filepath, size_t expected_keys = RFlowey::BLOOM_EXPECTED_KEYS)
+    : block_count_(block_count(expected_keys)), blocks_(new Block[block_count_]()), primary_hasher_(),
+      filepath_(std::move(filepath)) {
     if (!filepath_.empty()) {
       std::ifstream ifs(filepath_, std::ios::binary);
       if (ifs.is_open()) {
-        if (!this->load(ifs)) {
+        loaded_ = this->load(ifs);
+        if (!loaded_) {
           this->clear();
         }
         ifs.close();
       }
+      RFlowey::WriteAheadLog::instance().register_file(filepath_, [this] {
+        std::ostringstream os;
+        save(os);
+        return os.str();
+      }, [this] {
+        //only an add() that set a new bit or a clear() makes the filter worth logging again
+        return std::exchange(dirty_, false);
+      });
     }
   }
 
+  BloomFilter(const BloomFilter &) = delete;
+  BloomFilter &operator=(const BloomFilter &) = delete;
+
   ~BloomFilter() {
     if (!filepath_.empty()) {
-      std::ofstream ofs(filepath_, std::ios::binary | std::ios::trunc);
-      if (ofs.is_open()) {
-        if (!this->save(ofs)) {
-        }
-        ofs.close();
-      } else {
-        std::cerr << "Warning: BloomFilter could not open file for saving: " << filepath_ << std::endl;
-      }
+      RFlowey::WriteAheadLog::instance().unregister_file(filepath_);
     }
+    delete[] blocks_;
   }
 
-
   void add(const T &item) {
-    std::size_t h1 = primary_hasher_(item);
-    for (size_t i = 0; i < NumHashFunctions; ++i) {
-      std::size_t hash_val = (h1 + i * (h1 / (11 + i * i) + 1)) % BitArraySize; // Example perturbation
-      bits_[hash_val] = true;
+    std::uint64_t h = mix(primary_hasher_(item));
+    Block &block = blocks_[block_of(h)];
+    std::uint64_t probes = mix(h ^ PROBE_SEED);
+    for (size_t i = 0; i < NumHashFunctions; ++i, probes >>= 9) {
+      std::uint64_t &word = block.words[(probes >> 6) & 7];
+      std::uint64_t bit = std::uint64_t{1} << (probes & 63);
+      if (!(word & bit)) {
+        word |= bit;
+        dirty_ = true;
+      }
     }
+    ++added_;
   }
 
-  bool might_contain(const T &item) const {
-
-    cnt++;
-    std::size_t h1 = primary_hasher_(item);
-    for (size_t i = 0; i < NumHashFunctions; ++i) {
-      std::size_t hash_val = (h1 + i * (h1 / (11 + i * i) + 1)) % BitArraySize;
-      if (!bits_[hash_val]) {
-        hit++;
+  bool might_contain(const T &item) {
+    ++stats_.queries;
+    std::uint64_t h = mix(primary_hasher_(item));
+    const Block &block = blocks_[block_of(h)];
+    std::uint64_t probes = mix(h ^ PROBE_SEED);
+    for (size_t i = 0; i < NumHashFunctions; ++i, probes >>= 9) {
+      if (!(block.words[(probes >> 6) & 7] >> (probes & 63) & 1)) {
+        ++stats_.negatives;
         return false;
       }
     }
     return true;
   }
 
+  /**
+   * @brief the caller looked up an item that passed might_contain and did not find it
+   */
+  void note_false_positive() {
+    ++stats_.false_positives;
+  }
+
+  [[nodiscard]] const Stats &stats() const {
+    return stats_;
+  }
+
+  /**
+   * @brief whether the constructor restored the filter from its file, otherwise it must be refilled from the tree
+   */
+  [[nodiscard]] bool loaded() const {
+    return loaded_;
+  }
+
   void clear() {
-    bits_.assign(BitArraySize, false);
+    for (size_t i = 0; i < block_count_; ++i) {
+      blocks_[i] = Block{};
+    }
+    added_ = 0;
+    dirty_ = true;
   }
 
   bool save(std::ostream &os) const {
-    std::cerr<<"Hit rate:"<<hit<<'/'<<cnt<<'\n';
-    for (size_t i = 0; i < BitArraySize; ++i) {
-      char bit = bits_[i] ? '1' : '0';
-      if (!os.put(bit)) return false;
-    }
+    Header header{block_count_, added_};
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    os.write(reinterpret_cast<const char *>(blocks_), std::streamsize(block_count_ * sizeof(Block)));
     return os.good();
   }
 
+  /**
+   * @return false if the stream is short or was saved with another size
+   */
   bool load(std::istream &is) {
-    char bit_char;
-    for (size_t i = 0; i < BitArraySize; ++i) {
-      if (!is.get(bit_char)) {
-        return false;
-      }
-      if (bit_char == '1') {
-        bits_[i] = true;
-      } else if (bit_char == '0') {
-        bits_[i] = false;
-      } else {
-        return false;
-      }
+    Header header{};
+    if (!is.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.blocks != block_count_) {
+      return false;
     }
-    return is.good() || is.eof();
+    if (!is.read(reinterpret_cast<char *>(blocks_), std::streamsize(block_count_ * sizeof(Block)))) {
+      return false;
+    }
+    added_ = header.added;
+    dirty_ = true;
+    return true;
   }
 
 private:
-  std::vector<bool> bits_;
+  static constexpr std::uint64_t PROBE_SEED = 0x9e3779b97f4a7c15ULL;
+
+  size_t block_count_;
+  Block *blocks_;
+  size_t added_ = 0;
+  bool dirty_ = true;//set bits not logged yet
   [[no_unique_address]] PrimaryHasher primary_hasher_;
   std::string filepath_;
-  inline static size_t cnt=0;
-  inline static size_t hit=0;
+  bool loaded_ = false;
+  Stats stats_{};
+
+  static size_t block_count(size_t expected_keys) {
+    size_t bits = (expected_keys == 0 ? 1 : expected_keys) * RFlowey::BLOOM_BITS_PER_KEY;
+    return (bits + sizeof(Block) * 8 - 1) / (sizeof(Block) * 8);
+  }
+
+  //splitmix64 finalizer, the stored hashes are not mixed well enough to slice
+  static std::uint64_t mix(std::uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  [[nodiscard]] size_t block_of(std::uint64_t h) const {
+    return static_cast<size_t>(((h >> 32) * block_count_) >> 32);
+  }
 };
 
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename DiskManager = RFlowey::LoggedDiskManager,
+         typename Augment = RFlowey::NoAugment>
 class SingleMap {
 public:
-  using BPlusTree = RFlowey::BPT<Key, Value>;
+  using BPlusTree = RFlowey::BPT<Key, Value, DiskManager, Augment>;
+  using Cursor = typename BPlusTree::Cursor;
   BPlusTree bpt;
 
   explicit SingleMap(const std::string &path): bpt(path) {
   }
+  SingleMap(RFlowey::Tablespace &space, const std::string &name): bpt(space, name) {
+  }
 
   void insert(const Key &key, const Value &value) { bpt.insert(key, value); }
   void erase(const Key &key) { bpt.erase(key); }
@@ -125,6 +215,24 @@ public:
     return bpt.range_find(start, end);
   }
 
+  /**
+   * @brief cursor at the first entry >= key, see BPT::Cursor
+   */
+  Cursor seek(const Key &key) { return bpt.seek(key); }
+  /**
+   * @brief cursor at the last entry <= key, for newest-first scans
+   */
+  Cursor seek_for_prev(const Key &key) { return bpt.seek_for_prev(key); }
+
+  /**
+   * @param sorted entries sorted by key
+   */
+  void bulk_insert(const sjtu::vector<RFlowey::pair<Key, Value> > &sorted) { bpt.bulk_insert(sorted); }
+  /**
+   * @brief bottom-up build when the map is empty, bulk_insert otherwise
+   */
+  void bulk_load(const sjtu::vector<RFlowey::pair<Key, Value> > &sorted) { bpt.bulk_load(sorted); }
+
   bool modify(const Key &key, const Value &new_value) {
     return bpt.modify(key, new_value);
   }
@@ -137,61 +245,122 @@ public:
     return bpt.range_modify(start_key, end_key, func);
   }
 
+  /**
+   * @brief summary of [start_key, end_key], only with an augmented map (see my-bpt/augment.h)
+   */
+  auto range_aggregate(const Key &start_key, const Key &end_key) {
+    return bpt.range_aggregate(start_key, end_key);
+  }
+
+  /**
+   * @brief the k-th entry (from 0) with key in [start_key, end_key], only with RFlowey::CountAugment
+   */
+  std::optional<RFlowey::pair<Key, Value> > select(const Key &start_key, const Key &end_key, size_t k) {
+    return bpt.select(start_key, end_key, k);
+  }
+
   void clear() {
     bpt.clear();
   }
 };
 
-template<typename Key, typename Value, typename Hash = std::hash<Key> >
+template<typename Key, typename Value, typename Hash = std::hash<Key>, typename DiskManager = RFlowey::LoggedDiskManager>
 class HashedSingleMap {
 public:
-  using BPlusTree = RFlowey::BPT<hash_t, Value>;
+  using BPlusTree = RFlowey::BPT<hash_t, Value, DiskManager>;
+  using Cursor = typename BPlusTree::Cursor;//key() is the hash
   BPlusTree bpt;
-  //BloomFilter<hash_t,RFlowey::hashHasher> filter;
+  BloomFilter<hash_t, RFlowey::hashHasher> filter;//misses skip the tree, see filter.stats()
   [[no_unique_address]] Hash hash_func;
 
-  explicit HashedSingleMap(const std::string &path): bpt(path) {
+  explicit HashedSingleMap(const std::string &path): bpt(path), filter(path + ".bloom") {
+    refill_filter();
+  }
+  HashedSingleMap(RFlowey::Tablespace &space, const std::string &name): bpt(space, name), filter(name + ".bloom") {
+    refill_filter();
   }
 
+  /**
+   * @brief cursor over every stored value in hash order, past the Key{} sentinel of the tree
+   */
+  Cursor scan() { return bpt.seek(1); }
+
   void insert(const Key &key, const Value &value) {
-    bpt.insert(hash_func(key), value);
+    hash_t hashed_key = hash_func(key);
+    filter.add(hashed_key);
+    bpt.insert(hashed_key, value);
   }
   void erase(const Key &key) { bpt.erase(hash_func(key)); }
   std::optional<Value> find(const Key &key) {
-    return bpt.find(hash_func(key));
+    return find_by_hash(hash_func(key));
   }
   std::optional<Value> find_by_hash(const hash_t &hashed_key) {
-    return bpt.find(hashed_key);
+    if (!filter.might_contain(hashed_key)) {
+      return std::nullopt;
+    }
+    std::optional<Value> result = bpt.find(hashed_key);
+    if (!result) {
+      filter.note_false_positive();
+    }
+    return result;
   }
 
   bool modify(const Key &key, const Value &new_value) {
-    return bpt.modify(hash_func(key), new_value);
+    return modify_by_hash(hash_func(key), new_value);
   }
 
   bool modify_by_hash(const hash_t &hashed_key, const Value &new_value) {
-    return bpt.modify(hashed_key, new_value);
+    return filtered(hashed_key, [&] { return bpt.modify(hashed_key, new_value); });
   }
 
   bool modify(const Key &key, const std::function<void(Value&)>& func) {
-    return bpt.modify(hash_func(key), func);
+    return modify_by_hash(hash_func(key), func);
   }
 
   bool modify_by_hash(const hash_t &hashed_key, const std::function<void(Value&)>& func) {
-    return bpt.modify(hashed_key, func);
+    return filtered(hashed_key, [&] { return bpt.modify(hashed_key, func); });
   }
+
   void clear() {
     bpt.clear();
+    filter.clear();
+  }
+
+private:
+  //a tree without a usable filter file (older run, other filter size) gets its filter rebuilt from the keys
+  void refill_filter() {
+    if (filter.loaded()) {
+      return;
+    }
+    for (Cursor it = bpt.seek(0); it.valid(); it.next()) {
+      filter.add(it.key());
+    }
+  }
+
+  template<typename Lookup>
+  bool filtered(const hash_t &hashed_key, Lookup lookup) {
+    if (!filter.might_contain(hashed_key)) {
+      return false;
+    }
+    if (!lookup()) {
+      filter.note_false_positive();
+      return false;
+    }
+    return true;
   }
 };
 
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename DiskManager = RFlowey::LoggedDiskManager>
 class OrderedMultiMap {
 public:
-  using BPlusTree = RFlowey::BPT<RFlowey::pair<Key, Value>, RFlowey::Nothing>;
+  using BPlusTree = RFlowey::BPT<RFlowey::pair<Key, Value>, RFlowey::Nothing, DiskManager>;
+  using Cursor = typename BPlusTree::Cursor;//key() is the stored (key, value) pair
   BPlusTree bpt;
 
   explicit OrderedMultiMap(const std::string &path): bpt(path) {
   }
+  OrderedMultiMap(RFlowey::Tablespace &space, const std::string &name): bpt(space, name) {
+  }
 
   void insert(const Key &key, const Value &value) {
     bpt.insert({key, value}, RFlowey::Nothing{});
@@ -201,60 +370,142 @@ public:
     bpt.erase({key, value});
   }
 
+  /**
+   * @brief insert a batch of entries in any order, they are sorted first
+   */
+  void bulk_insert(const sjtu::vector<RFlowey::pair<Key, Value> > &items) {
+    bpt.bulk_insert(sort_entries(items));
+  }
+  void bulk_load(const sjtu::vector<RFlowey::pair<Key, Value> > &items) {
+    bpt.bulk_load(sort_entries(items));
+  }
+
   sjtu::vector<RFlowey::pair<Key, Value> > find_range(const Key &start_k, const Key &end_k) {
     sjtu::vector<RFlowey::pair<Key, Value> > return_val;
-    auto bpt_result_vec = bpt.range_find(
-      RFlowey::pair<Key, Value>{start_k, Value{}},
-      RFlowey::pair<Key, Value>{end_k, Value{}}
-    );
-    for (const auto &bpt_pair_entry: bpt_result_vec) {
-      if (bpt_pair_entry.first.first >= start_k && bpt_pair_entry.first.first <= end_k) {
-        return_val.push_back(bpt_pair_entry.first);
-      }
+    for (Cursor it = seek(start_k); it.valid() && it.key().first <= end_k; it.next()) {
+      return_val.push_back(it.key());
     }
     return return_val;
   }
+
+  Cursor seek(const Key &key, const Value &value = Value{}) {
+    return bpt.seek({key, value});
+  }
+  Cursor seek_for_prev(const Key &key, const Value &value) {
+    return bpt.seek_for_prev({key, value});
+  }
   void clear() {
     bpt.clear();
   }
+
+private:
+  sjtu::vector<RFlowey::pair<RFlowey::pair<Key, Value>, RFlowey::Nothing> > sort_entries(
+    const sjtu::vector<RFlowey::pair<Key, Value> > &items) {
+    sjtu::vector<RFlowey::pair<RFlowey::pair<Key, Value>, RFlowey::Nothing> > entries;
+    for (const auto &item: items) {
+      entries.push_back({item, RFlowey::Nothing{}});
+    }
+    RFlowey::quick_sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+      return a.first < b.first;
+    });
+    return entries;
+  }
 };
 
-template<typename Key, typename Value, typename Hash = std::hash<Key> >
+template<typename Key, typename Value, typename Hash = std::hash<Key>, typename DiskManager = RFlowey::LoggedDiskManager>
 class OrderedHashMap {
 public:
-  using BPlusTree = RFlowey::BPT<RFlowey::pair<hash_t, Value>, RFlowey::Nothing>;
+  using BPlusTree = RFlowey::BPT<RFlowey::pair<hash_t, Value>, RFlowey::Nothing, DiskManager>;
+  using Cursor = typename BPlusTree::Cursor;//key() is the stored (hash, value) pair
   BPlusTree bpt;
-  //BloomFilter<hash_t,RFlowey::hashHasher> filter;
+  BloomFilter<hash_t, RFlowey::hashHasher> filter;//over the hashes, erased ones stay until clear()
   [[no_unique_address]] Hash hash_func;
 
-  explicit OrderedHashMap(const std::string &path): bpt(path) {
+  explicit OrderedHashMap(const std::string &path): bpt(path), filter(path + ".bloom") {
+    refill_filter();
+  }
+  OrderedHashMap(RFlowey::Tablespace &space, const std::string &name): bpt(space, name), filter(name + ".bloom") {
+    refill_filter();
   }
 
   ~OrderedHashMap() = default;
 
   void insert(const Key &key, const Value &value) {
-    bpt.insert({hash_func(key), value}, RFlowey::Nothing{});
+    hash_t hashed_key = hash_func(key);
+    filter.add(hashed_key);
+    bpt.insert({hashed_key, value}, RFlowey::Nothing{});
   }
 
   void erase(const Key &key, const Value &value) {
     bpt.erase({hash_func(key), value});
   }
 
+  /**
+   * @brief insert a batch of entries in any order, they are hashed and sorted first
+   */
+  void bulk_insert(const sjtu::vector<RFlowey::pair<Key, Value> > &items) {
+    bpt.bulk_insert(hash_and_sort(items));
+  }
+  void bulk_load(const sjtu::vector<RFlowey::pair<Key, Value> > &items) {
+    bpt.bulk_load(hash_and_sort(items));
+  }
+
   sjtu::vector<Value> find(const Key &key) {
     return find_by_hash(hash_func(key));
   }
 
   sjtu::vector<Value> find_by_hash(const hash_t &hashed_key) {
-    auto result_bpt = bpt.range_find({hashed_key, Value{}}, {hashed_key + 1, Value{}});
     sjtu::vector<Value> return_val;
-    for (auto &i: result_bpt) {
-      if (i.first.first == hashed_key) {
-        return_val.push_back(i.first.second);
-      }
+    if (!might_contain_hash(hashed_key)) {
+      return return_val;
+    }
+    for (Cursor it = seek_by_hash(hashed_key); it.valid() && it.key().first == hashed_key; it.next()) {
+      return_val.push_back(it.key().second);
+    }
+    if (return_val.empty()) {
+      filter.note_false_positive();
     }
     return return_val;
   }
+
+  /**
+   * @brief false only if nothing was ever stored under hashed_key since the last clear()
+   */
+  bool might_contain_hash(const hash_t &hashed_key) {
+    return filter.might_contain(hashed_key);
+  }
+
+  /**
+   * @brief cursor at the first value stored under hashed_key, stop once key().first changes
+   */
+  Cursor seek_by_hash(const hash_t &hashed_key) {
+    return bpt.seek({hashed_key, Value{}});
+  }
   void clear() {
     bpt.clear();
+    filter.clear();
+  }
+
+private:
+  void refill_filter() {
+    if (filter.loaded()) {
+      return;
+    }
+    for (Cursor it = bpt.seek({0, Value{}}); it.valid(); it.next()) {
+      filter.add(it.key().first);
+    }
+  }
+
+  sjtu::vector<RFlowey::pair<RFlowey::pair<hash_t, Value>, RFlowey::Nothing> > hash_and_sort(
+    const sjtu::vector<RFlowey::pair<Key, Value> > &items) {
+    sjtu::vector<RFlowey::pair<RFlowey::pair<hash_t, Value>, RFlowey::Nothing> > entries;
+    for (const auto &item: items) {
+      filter.add(hash_func(item.first));
+      entries.push_back({RFlowey::pair<hash_t, Value>{hash_func(item.first), item.second}, RFlowey::Nothing{}});
+    }
+    RFlowey::quick_sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+      return a.first < b.first;
+    });
+    return entries;
   }
 };
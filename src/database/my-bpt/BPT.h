@@ -1,26 +1,46 @@
 #pragma once
+#include <cstdint>
 #include <filesystem>
 #include <limits>
+#include <memory>
 #include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 #include "disk/IO_manager.h"
 #include "disk/IO_utils.h"
+#include "disk/tablespace.h"
 #include "stlite/utils.h"
 #include "stlite/vector.hpp"
 #include "Node.h"
 #include "common.h"
 #include "my_fileconfig.h"
+#include "augment.h"
 
 
 namespace RFlowey {
 
-  template<typename Key, typename Value> // KeyHash removed
+  /**
+   * @tparam DiskManager IOManager backing the tree file, LoggedDiskManager by default, or an unlogged PosixDiskManager, SimpleDiskManager, MmapDiskManager
+   * @tparam Augment summary kept per child slot of inner nodes for range_aggregate, see augment.h
+   */
+  template<typename Key, typename Value, typename DiskManager = LoggedDiskManager, typename Augment = NoAugment> // KeyHash removed
   class BPT {
+    static_assert(std::is_base_of_v<IOManager, DiskManager>, "DiskManager must implement IOManager");
+    static constexpr bool augmented = AugmentTraits<Augment>::enabled;
+    using summary_t = typename AugmentTraits<Augment>::summary_type;
+    using Child = typename AugmentTraits<Augment>::child_type; // page_id_t unless augmented
     // key_type is now Key itself. BPTNode will use this Key directly.
-    using InnerNode = BPTNode<Key, page_id_t, Inner>;
+    using InnerNode = BPTNode<Key, Child, Inner>;
     using LeafNode = BPTNode<Key, Value, Leaf>; // Leaf node stores pair<Key, Value>
 
-    SimpleDiskManager manager_;
+    //a tree on its own file owns its disk and pool, a tree in a Tablespace borrows the shared pool
+    std::unique_ptr<DiskManager> own_disk_;
+    std::unique_ptr<BufferPoolManager> own_pool_;
+    Tablespace *space_ = nullptr;
+    size_t catalog_slot_ = 0;
+    BufferPoolManager *manager_;
     PagePtr<InnerNode> root_;
     int layer = 0; // Number of inner node levels above leaves. Root is at depth 0.
 
@@ -28,9 +48,42 @@ namespace RFlowey {
       bool is_set;
       int layer;
       page_id_t root_id;
+      std::uint64_t layout;//LAYOUT of the tree that wrote it
     };
 
-    RFlowey::FiledConfig::tracker_t_<BPT_config> persis_config = RFlowey::FiledConfig::track<BPT_config>(BPT_config{false,0,0});
+    //entry sizes of both node kinds, a tree stored with other Key, Value or Augment types cannot be read
+    static constexpr std::uint64_t LAYOUT =
+        static_cast<std::uint64_t>(sizeof(typename LeafNode::value_type)) << 32 | sizeof(typename InnerNode::value_type);
+
+    //FiledConfig slot of a tree on its own file, the catalog holds it inside a Tablespace
+    std::optional<RFlowey::FiledConfig::tracker_t_<BPT_config>> persis_config;
+
+    //kept current on every root change, a WAL commit snapshots the tracked values and the catalog page
+    void save_config() {
+      BPT_config config{true, layer, root_.page_id(), LAYOUT};
+      if (space_ != nullptr) {
+        space_->store_config(catalog_slot_, config);
+      } else {
+        persis_config->val = config;
+      }
+    }
+
+    //hand every page below page_id back to the disk, inner levels are 0..layer
+    void release_pages(page_id_t page_id, int depth) {
+      if (depth <= layer) {
+        sjtu::vector<page_id_t> children;
+        {
+          ConstPageRef<InnerNode> node = PagePtr<InnerNode>{page_id, manager_}.get_const_ref();
+          for (index_type i = 0; i < node->current_size_; ++i) {
+            children.push_back(node->at(i).second);
+          }
+        }
+        for (page_id_t child: children) {
+          release_pages(child, depth + 1);
+        }
+      }
+      manager_->DeletePage(page_id);
+    }
 
     struct FindResult {
       pair<PageRef<LeafNode>, index_type> cur_pos; // cur_pos.second is result of BPTNode::search
@@ -39,66 +92,324 @@ namespace RFlowey {
 
     enum class OperationType { FIND, INSERT, DELETE };
 
+    /**
+     * @brief read-only descent, no page on the path is marked dirty
+     * @param upper if given, receives the smallest separator greater than the leaf's range (none for the last leaf)
+     * @return page id of the leaf that may contain key
+     */
+    page_id_t find_leaf(const Key &key, std::optional<Key> *upper = nullptr) {
+      page_id_t next_page_id = root_.page_id();
+      for (int i = 0; i <= layer; ++i) {
+        ConstPageRef<InnerNode> cur_inner_node = PagePtr<InnerNode>{next_page_id, manager_}.get_const_ref();
+        index_type current_path_idx = cur_inner_node->search(key);
+        if (current_path_idx == INVALID_PAGE_ID) {
+          current_path_idx = 0;
+        }
+        if (upper && current_path_idx + 1 < cur_inner_node->current_size_) {
+          *upper = cur_inner_node->at(current_path_idx + 1).first;
+        }
+        next_page_id = cur_inner_node->at(current_path_idx).second;
+      }
+      return next_page_id;
+    }
+
+    /**
+     * @brief write one level of a bulk load, nodes are filled evenly to about BULK_FILL_RATE and linked
+     * @return (first key, page id) of every node written, i.e. the entries of the level above
+     */
+    template<typename Node>
+    sjtu::vector<typename InnerNode::value_type> build_level(const sjtu::vector<typename Node::value_type> &entries) {
+      constexpr int target = int(BULK_FILL_RATE * Node::SIZEMAX) < Node::SPLIT_T - 1
+                               ? int(BULK_FILL_RATE * Node::SIZEMAX) : Node::SPLIT_T - 1;
+      constexpr int fill = target > Node::MERGE_T + 2 ? target : Node::MERGE_T + 2;
+      sjtu::vector<typename InnerNode::value_type> upper_level;
+      size_t count = (entries.size() + fill - 1) / fill;
+      size_t base = entries.size() / count, extra = entries.size() % count;
+      size_t pos = 0;
+      page_id_t prev_id = INVALID_PAGE_ID;
+      page_id_t cur_id = manager_->AllocatePage();
+      for (size_t i = 0; i < count; ++i) {
+        size_t size = base + (i < extra ? 1 : 0);
+        page_id_t next_id = i + 1 < count ? manager_->AllocatePage() : INVALID_PAGE_ID;
+        PageRef<Node> node_ref = PagePtr<Node>{cur_id, manager_}.make_ref(cur_id);
+        Node &node = *node_ref;
+        node.prev_node_id_ = prev_id;
+        node.next_node_id_ = next_id;
+        node.current_size_ = size;
+        for (size_t j = 0; j < size; ++j) {
+          node.data_[j] = entries[pos + j];
+        }
+        Child child = cur_id;
+        if constexpr (augmented) {
+          child.summary = summarize(std::as_const(node));
+        }
+        upper_level.push_back({entries[pos].first, child});
+        pos += size;
+        prev_id = cur_id;
+        cur_id = next_id;
+      }
+      return upper_level;
+    }
+
+    bool is_empty() {
+      if (layer != 0) {
+        return false;
+      }
+      ConstPageRef<InnerNode> root_ref = root_.get_const_ref();
+      if (root_ref->current_size_ != 1) {
+        return false;
+      }
+      return PagePtr<LeafNode>{root_ref->at(0).second, manager_}.get_const_ref()->current_size_ == 1;
+    }
+
     FindResult find_pos(const Key &key, OperationType type) {
 #ifdef BPT_TEST
       assert(root_.page_id() != INVALID_PAGE_ID && root_.page_id() != 0 && "find_pos called with invalid root");
       assert(layer >= 0 && "find_pos called with invalid layer");
 #endif
       sjtu::vector<pair<PageRef<InnerNode>, index_type> > parents;
+      if (type == OperationType::FIND) {
+        PageRef<LeafNode> leaf_ref = PagePtr<LeafNode>{find_leaf(key), manager_}.get_ref();
+        index_type idx_in_leaf = std::as_const(leaf_ref)->search(key);
+        return {{std::move(leaf_ref), idx_in_leaf}, std::move(parents)};
+      }
       page_id_t next_page_id = root_.page_id();
       index_type current_path_idx; // Index used in parent vector, refers to data_[idx] in parent
 
       for (int i = 0; i <= layer; ++i) {
-        PageRef<InnerNode> cur_inner_node = PagePtr<InnerNode>{next_page_id, &manager_}.get_ref();
+        PageRef<InnerNode> cur_inner_node = PagePtr<InnerNode>{next_page_id, manager_}.get_ref();
+        // Only read through a const view here, the node is dirtied later iff it is really modified
+        const InnerNode &inner = *std::as_const(cur_inner_node);
 #ifdef BPT_TEST
-        assert(cur_inner_node->current_size_ > 0 && "Inner node on path is empty");
+        assert(inner.current_size_ > 0 && "Inner node on path is empty");
 #endif
-        current_path_idx = cur_inner_node->search(key); // BPTNode::search now compares Key directly
+        current_path_idx = inner.search(key); // BPTNode::search now compares Key directly
 
         if (current_path_idx == INVALID_PAGE_ID) {
           current_path_idx = 0;
         }
 #ifdef BPT_TEST
-        assert(current_path_idx < cur_inner_node->current_size_ && \
+        assert(current_path_idx < inner.current_size_ && \
                "Search index out of bounds in inner node after valid return.");
 #endif
-        next_page_id = cur_inner_node->at(current_path_idx).second; // .second is page_id_t
+        next_page_id = inner.at(current_path_idx).second; // .second is page_id_t
 
-        if (type != OperationType::FIND) {
-          bool is_safe_for_op = (type == OperationType::INSERT && cur_inner_node->is_upper_safe()) ||
-                                (type == OperationType::DELETE && cur_inner_node->is_lower_safe());
-          if (is_safe_for_op) {
-            parents.clear();
-          }
-          parents.emplace_back(std::move(cur_inner_node), current_path_idx);
+        bool is_safe_for_op = (type == OperationType::INSERT && inner.is_upper_safe()) ||
+                              (type == OperationType::DELETE && inner.is_lower_safe());
+        if (is_safe_for_op) {
+          parents.clear();
         }
+        parents.emplace_back(std::move(cur_inner_node), current_path_idx);
       }
 
-      PageRef<LeafNode> leaf_ref = PagePtr<LeafNode>{next_page_id, &manager_}.get_ref();
-      if (type != OperationType::FIND) {
-        bool is_leaf_safe_for_op = (type == OperationType::INSERT && leaf_ref->is_upper_safe()) ||
-                                   (type == OperationType::DELETE && leaf_ref->is_lower_safe());
-        if (is_leaf_safe_for_op) {
-          parents.clear();
-        }
+      PageRef<LeafNode> leaf_ref = PagePtr<LeafNode>{next_page_id, manager_}.get_ref();
+      const LeafNode &leaf = *std::as_const(leaf_ref);
+      bool is_leaf_safe_for_op = (type == OperationType::INSERT && leaf.is_upper_safe()) ||
+                                 (type == OperationType::DELETE && leaf.is_lower_safe());
+      if (is_leaf_safe_for_op) {
+        parents.clear();
       }
 
-      index_type idx_in_leaf = leaf_ref->search(key); // BPTNode::search compares Key directly
+      index_type idx_in_leaf = leaf.search(key); // BPTNode::search compares Key directly
 
       return {{std::move(leaf_ref), idx_in_leaf}, std::move(parents)};
     }
 
+    summary_t summarize(const LeafNode &leaf) const {
+      summary_t summary = Augment::identity();
+      for (size_t i = 0; i < leaf.current_size_; ++i) {
+        summary = Augment::combine(summary, Augment::lift(leaf.data_[i].first, leaf.data_[i].second));
+      }
+      return summary;
+    }
+
+    summary_t summarize(const InnerNode &node) const {
+      summary_t summary = Augment::identity();
+      for (size_t i = 0; i < node.current_size_; ++i) {
+        summary = Augment::combine(summary, node.data_[i].second.summary);
+      }
+      return summary;
+    }
+
+    template<typename Node>
+    Key first_key(page_id_t page_id) {
+      return PagePtr<Node>{page_id, manager_}.get_const_ref()->data_[0].first;
+    }
+
+    /**
+     * @brief recompute the summaries on the root-to-leaf path of key, bottom-up.
+     * A slot is only written, and its page dirtied, when the summary really changed.
+     */
+    void refresh_path(const Key &key) {
+      sjtu::vector<pair<page_id_t, index_type>> path;
+      page_id_t next_page_id = root_.page_id();
+      for (int i = 0; i <= layer; ++i) {
+        ConstPageRef<InnerNode> node = PagePtr<InnerNode>{next_page_id, manager_}.get_const_ref();
+        index_type idx = node->search(key);
+        if (idx == INVALID_PAGE_ID) {
+          idx = 0;
+        }
+        path.push_back({next_page_id, idx});
+        next_page_id = node->at(idx).second;
+      }
+      summary_t summary = summarize(*PagePtr<LeafNode>{next_page_id, manager_}.get_const_ref());
+      for (size_t i = path.size(); i-- > 0;) {
+        PagePtr<InnerNode> node_ptr{path[i].first, manager_};
+        ConstPageRef<InnerNode> node = node_ptr.get_const_ref();
+        if (!(node->data_[path[i].second].second.summary == summary)) {
+          node_ptr.get_ref()->data_[path[i].second].second.summary = summary;
+        }
+        summary = summarize(*node);
+      }
+    }
+
+    /**
+     * @param lower,upper key range routed to this node, nullopt for unbounded
+     */
+    summary_t aggregate_node(page_id_t page_id, int depth, const Key &lo, const Key &hi,
+                             const std::optional<Key> &lower, const std::optional<Key> &upper) {
+      summary_t result = Augment::identity();
+      if (depth > layer) {
+        ConstPageRef<LeafNode> leaf = PagePtr<LeafNode>{page_id, manager_}.get_const_ref();
+        for (size_t i = 0; i < leaf->current_size_ && leaf->data_[i].first <= hi; ++i) {
+          if (lo <= leaf->data_[i].first) {
+            result = Augment::combine(result, Augment::lift(leaf->data_[i].first, leaf->data_[i].second));
+          }
+        }
+        return result;
+      }
+      ConstPageRef<InnerNode> node = PagePtr<InnerNode>{page_id, manager_}.get_const_ref();
+      for (size_t i = 0; i < node->current_size_; ++i) {
+        std::optional<Key> child_lower = i == 0 ? lower : std::optional<Key>(node->data_[i].first);
+        std::optional<Key> child_upper = i + 1 < node->current_size_ ? std::optional<Key>(node->data_[i + 1].first) : upper;
+        if (child_upper && *child_upper <= lo) {
+          continue;
+        }
+        if (child_lower && hi < *child_lower) {
+          break;
+        }
+        if (child_lower && lo <= *child_lower && child_upper && *child_upper <= hi) {
+          result = Augment::combine(result, node->data_[i].second.summary); // whole child inside [lo, hi]
+        } else {
+          result = Augment::combine(result, aggregate_node(node->data_[i].second, depth + 1, lo, hi, child_lower, child_upper));
+        }
+      }
+      return result;
+    }
+
   public:
-    explicit BPT(const std::string &file_name): manager_(file_name), root_(INVALID_PAGE_ID, nullptr) {
-      BPT_config config = persis_config.val;
+    /**
+     * Walks the leaf chain in key order, in either direction, keeping only the current leaf pinned.
+     * The tree must not be modified while a cursor is open.
+     * The leftmost leaf starts with the {Key{}, Value{}} sentinel, scans are expected to be bounded by key.
+     */
+    class Cursor {
+      BufferPoolManager *manager_ = nullptr;
+      ConstPageRef<LeafNode> leaf_;
+      index_type idx_ = 0;
+      bool valid_ = false;
+
+      void reset() {
+        leaf_.Drop();
+        valid_ = false;
+      }
+      //move right until idx_ points at an entry
+      void settle_forward() {
+        while (idx_ >= leaf_->current_size_) {
+          page_id_t next_id = leaf_->next_node_id_;
+          if (next_id == INVALID_PAGE_ID) {
+            reset();
+            return;
+          }
+          leaf_ = PagePtr<LeafNode>{next_id, manager_}.get_const_ref();
+          idx_ = 0;
+        }
+      }
+      //the current leaf is exhausted on the left, go to the last entry of the previous non-empty leaf
+      void step_back_leaf() {
+        do {
+          page_id_t prev_id = leaf_->prev_node_id_;
+          if (prev_id == INVALID_PAGE_ID) {
+            reset();
+            return;
+          }
+          leaf_ = PagePtr<LeafNode>{prev_id, manager_}.get_const_ref();
+        } while (leaf_->current_size_ == 0);
+        idx_ = leaf_->current_size_ - 1;
+      }
+
+      friend class BPT;
+      Cursor(BufferPoolManager *manager, page_id_t leaf_id)
+        : manager_(manager), leaf_(PagePtr<LeafNode>{leaf_id, manager}.get_const_ref()), valid_(true) {
+      }
 
+    public:
+      Cursor() = default;
+
+      [[nodiscard]] bool valid() const {
+        return valid_;
+      }
+      void next() {
+        ++idx_;
+        settle_forward();
+      }
+      void prev() {
+        if (idx_ > 0) {
+          --idx_;
+        } else {
+          step_back_leaf();
+        }
+      }
+      [[nodiscard]] const Key &key() const {
+        return leaf_->data_[idx_].first;
+      }
+      [[nodiscard]] const Value &value() const {
+        return leaf_->data_[idx_].second;
+      }
+    };
+
+    /**
+     * @return cursor at the first entry with key >= key, invalid if there is none
+     */
+    Cursor seek(const Key &key) {
+      Cursor cursor{manager_, find_leaf(key)};
+      index_type idx = cursor.leaf_->search(key);
+      if (idx == INVALID_PAGE_ID) {
+        cursor.idx_ = 0;
+      } else {
+        cursor.idx_ = cursor.leaf_->data_[idx].first < key ? idx + 1 : idx;
+      }
+      cursor.settle_forward();
+      return cursor;
+    }
+
+    /**
+     * @return cursor at the last entry with key <= key, invalid if there is none
+     */
+    Cursor seek_for_prev(const Key &key) {
+      Cursor cursor{manager_, find_leaf(key)};
+      index_type idx = cursor.leaf_->search(key);
+      if (idx == INVALID_PAGE_ID) {
+        cursor.step_back_leaf();
+      } else {
+        cursor.idx_ = idx;
+      }
+      return cursor;
+    }
+
+  private:
+    //set up root_ and layer from a stored config, or build an empty tree
+    void open_root(const BPT_config &config) {
+      if (config.is_set && config.layout != LAYOUT) {
+        throw std::runtime_error("BPT: the tree was written with another record layout");
+      }
       if(!config.is_set) {
 #ifdef BPT_TEST
       std::cerr << "Initializing new BPT database..." << std::endl;
       assert(root_.page_id() == INVALID_PAGE_ID && "Root should be invalid before new DB init");
 #endif
-      PagePtr<InnerNode> new_root_ptr = allocate<InnerNode>(&manager_);
-      PagePtr<LeafNode> first_leaf_ptr = allocate<LeafNode>(&manager_);
+      PagePtr<InnerNode> new_root_ptr = allocate<InnerNode>(manager_);
+      PagePtr<LeafNode> first_leaf_ptr = allocate<LeafNode>(manager_);
 
       this->layer = 0;
       this->root_ = new_root_ptr;
@@ -112,6 +423,10 @@ namespace RFlowey {
       // InnerNode::value_type is pair<Key, page_id_t>
       typename InnerNode::value_type initial_root_data[1] = {{Key{}, first_leaf_ptr.page_id()}};
       new_root_ptr.make_ref(InnerNode{new_root_ptr.page_id(), 1, initial_root_data});
+      if constexpr (augmented) {
+        refresh_path(Key{});
+      }
+      save_config();
     } else {
 #ifdef BPT_TEST
       assert(cfg_ref->is_set && "Config page not marked as set.");
@@ -120,29 +435,53 @@ namespace RFlowey {
       assert(cfg_ref->root_id != DISK_PAGE_CONFIG_ID && "Root ID cannot be config page ID");
       std::cerr << "Loading existing BPT database..." << std::endl;
 #endif
-      this->root_ = PagePtr<InnerNode>{config.root_id, &manager_};
+      this->root_ = PagePtr<InnerNode>{config.root_id, manager_};
       this->layer = config.layer;
     }
   }
 
+  public:
+    /**
+     * @throw std::runtime_error if the file holds a tree of another record layout
+     */
+    explicit BPT(const std::string &file_name, size_t pool_size = BUFFER_POOL_SIZE)
+      : own_disk_(std::make_unique<DiskManager>(file_name)),
+        own_pool_(std::make_unique<BufferPoolManager>(pool_size, own_disk_.get())),
+        manager_(own_pool_.get()), root_(INVALID_PAGE_ID, nullptr) {
+      persis_config.emplace(BPT_config{false, 0, 0, 0});
+      if (!persis_config->val.is_set && !own_disk_->is_new) {
+        manager_->Clear();//pages without a config cannot be reached, start over
+      }
+      open_root(persis_config->val);
+    }
+
+    /**
+     * @brief open or create the tree `name` of a tablespace, its pages come from the shared pool and free list
+     * @throw std::length_error if the tablespace cannot take another tree
+     * @throw std::runtime_error if the tree was stored with another record layout
+     */
+    BPT(Tablespace &space, const std::string &name)
+      : space_(&space), manager_(space.pool()), root_(INVALID_PAGE_ID, nullptr) {
+      catalog_slot_ = space.open(name);
+      open_root(space.load_config<BPT_config>(catalog_slot_));
+    }
+
     ~BPT() {
 #ifdef BPT_TEST
       std::cerr << "BPT Destructor: Saving config. Layer=" << layer
                 << ", RootID=" << (root_.page_id() == INVALID_PAGE_ID ? -1 : root_.page_id()) << std::endl;
 #endif
       if (root_.page_id() != INVALID_PAGE_ID && root_.page_id() != 0) {
-        BPT_config cfg_to_save = {true, layer, root_.page_id()};
-        persis_config.val = cfg_to_save;
+        save_config();
       }
     }
 
     std::optional<Value> find(const Key &key) {
-      auto result = find_pos(key, OperationType::FIND);
-      PageRef<LeafNode>& leaf_ref = result.cur_pos.first;
-      index_type index_in_leaf = result.cur_pos.second;
+      ConstPageRef<LeafNode> leaf_ref = PagePtr<LeafNode>{find_leaf(key), manager_}.get_const_ref();
+      index_type index_in_leaf = leaf_ref->search(key);
 
       if (index_in_leaf != INVALID_PAGE_ID && index_in_leaf < leaf_ref->current_size_) {
-        const auto& item = leaf_ref->at(index_in_leaf); // item is pair<Key, Value>
+        const auto& item = leaf_ref->data_[index_in_leaf]; // item is pair<Key, Value>
         if (item.first == key) { // Direct key comparison
           return item.second; // Return Value
         }
@@ -151,17 +490,25 @@ namespace RFlowey {
     }
 
     void insert(const Key &key, const Value &value) {
+      insert_impl(key, value);
+      if constexpr (augmented) {
+        refresh_path(key);
+      }
+    }
+
+  private:
+    void insert_impl(const Key &key, const Value &value) {
       auto [pos_pair, parents] = find_pos(key, OperationType::INSERT);
       PageRef<LeafNode>& leaf_ref = pos_pair.first;
       index_type search_idx_in_leaf = pos_pair.second;
 
       // Check if key already exists to update it
-      if (search_idx_in_leaf != INVALID_PAGE_ID && search_idx_in_leaf < leaf_ref->current_size_) {
+      if (search_idx_in_leaf != INVALID_PAGE_ID && search_idx_in_leaf < std::as_const(leaf_ref)->current_size_) {
         // BPTNode::data_ is protected. To modify, PageRef needs to allow it or BPTNode needs an update method.
         // Assuming direct access for modification via PageRef for this example.
         // This might require leaf_ref.operator->()->data_[search_idx_in_leaf] or similar.
         // For simplicity, using leaf_ref->data_ as if it's directly modifiable.
-        if (leaf_ref->data_[search_idx_in_leaf].first == key) {
+        if (std::as_const(leaf_ref)->data_[search_idx_in_leaf].first == key) {
           leaf_ref->data_[search_idx_in_leaf].second = value; // Update existing key's value
           // leaf_ref.mark_dirty(); // If PageRef requires explicit dirty marking
           return;
@@ -192,9 +539,15 @@ namespace RFlowey {
       }
       // If it reaches here, parents was not empty (unsafe path) AND leaf is now full.
 
-      PageRef<LeafNode> new_leaf_page_ref = leaf_ref->split(allocate<LeafNode>(&manager_));
+      PageRef<LeafNode> new_leaf_page_ref = leaf_ref->split(allocate<LeafNode>(manager_));
       page_id_t new_node_page_id = new_leaf_page_ref->self_id_;
       Key promoted_key = new_leaf_page_ref->get_first(); // This is a Key from new leaf's data_[0].first
+      // Summaries of the two halves, the slot of the half off the key's path is not refreshed later
+      [[maybe_unused]] summary_t left_summary{}, right_summary{};
+      if constexpr (augmented) {
+        left_summary = summarize(*std::as_const(leaf_ref));
+        right_summary = summarize(*std::as_const(new_leaf_page_ref));
+      }
 
       // Propagate split upwards
       while (!parents.empty()) {
@@ -204,35 +557,53 @@ namespace RFlowey {
 
         // InnerNode stores pair<Key, page_id_t>
         parent_node->insert_at(insert_idx_in_parent, {promoted_key, new_node_page_id});
+        if constexpr (augmented) {
+          parent_node->data_[insert_idx_in_parent].second.summary = left_summary;
+          parent_node->data_[insert_idx_in_parent + 1].second.summary = right_summary;
+        }
 
         if (parent_node->current_size_ < InnerNode::SPLIT_T) { // Parent absorbed new key, no further split
           return;
         }
 
         // Parent also splits
-        PageRef<InnerNode> new_inner_page_ref = parent_node->split(allocate<InnerNode>(&manager_));
+        PageRef<InnerNode> new_inner_page_ref = parent_node->split(allocate<InnerNode>(manager_));
         new_node_page_id = new_inner_page_ref->self_id_;
         promoted_key = new_inner_page_ref->get_first(); // Key from new inner node's data_[0].first
+        if constexpr (augmented) {
+          left_summary = summarize(*std::as_const(parent_node));
+          right_summary = summarize(*std::as_const(new_inner_page_ref));
+        }
       }
 
       // If loop finishes, root was split
-      PagePtr<InnerNode> new_root_ptr = allocate<InnerNode>(&manager_);
+      PagePtr<InnerNode> new_root_ptr = allocate<InnerNode>(manager_);
       typename InnerNode::value_type new_root_data[2] = {
           {Key{}, root_.page_id()},       // Old root is first child, with sentinel Key{}
           {promoted_key, new_node_page_id} // New node from root split is second child
       };
+      if constexpr (augmented) {
+        new_root_data[0].second.summary = left_summary;
+        new_root_data[1].second.summary = right_summary;
+      }
       new_root_ptr.make_ref(InnerNode{new_root_ptr.page_id(), 2, new_root_data});
       root_ = new_root_ptr;
       ++layer;
+      save_config();
     }
 
-    bool erase(const Key& key) {
+    /**
+     * @return false if key was not found.
+     * @param merged_into if not null, receives the first key of every node that absorbed a merged sibling
+     */
+    bool erase_impl(const Key& key, sjtu::vector<Key> *merged_into) {
       auto [pos_pair, parents] = find_pos(key, OperationType::DELETE);
       PageRef<LeafNode>& leaf_ref = pos_pair.first;
       index_type found_idx_in_leaf = pos_pair.second;
 
-      if (found_idx_in_leaf == INVALID_PAGE_ID || found_idx_in_leaf >= leaf_ref->current_size_ ||
-          leaf_ref->at(found_idx_in_leaf).first != key) { // Direct key comparison
+      const LeafNode &leaf = *std::as_const(leaf_ref);
+      if (found_idx_in_leaf == INVALID_PAGE_ID || found_idx_in_leaf >= leaf.current_size_ ||
+          leaf.at(found_idx_in_leaf).first != key) { // Direct key comparison
         return false; // Key not found
       }
 
@@ -255,8 +626,11 @@ namespace RFlowey {
           // BPTNode::merge merges with prev_node_id_.
           // It asserts if prev_node_id_ is INVALID_PAGE_ID.
           if (leaf_ref->prev_node_id_ != INVALID_PAGE_ID) {
-              if (leaf_ref->merge(&manager_)) { // Try to merge with previous sibling
+              if (leaf_ref->merge(manager_)) { // Try to merge with previous sibling
                   needs_parent_update = true; // Merge succeeded, leaf_ref is now invalid/deleted. Parent needs update.
+                  if (merged_into) {
+                      merged_into->push_back(first_key<LeafNode>(std::as_const(leaf_ref)->prev_node_id_));
+                  }
               } else {
                   // Merge failed (e.g., redistribution happened if implemented, or prev sibling too full).
                   // No structural change to propagate upwards from this merge attempt.
@@ -291,9 +665,10 @@ namespace RFlowey {
                 // If root has only one child left (which must be associated with Key{} sentinel) and layer > 0
                 if (parent_node->current_size_ == 1 && layer > 0 && parent_node->at(0).first == Key{}) {
                     page_id_t old_root_page_id = parent_node->get_self();
-                    root_ = PagePtr<InnerNode>{parent_node->at(0).second, &manager_}; // New root is this single child
+                    root_ = PagePtr<InnerNode>{parent_node->at(0).second, manager_}; // New root is this single child
                     --layer;
-                    manager_.DeletePage(old_root_page_id); // Delete old root page
+                    save_config();
+                    manager_->DeletePage(old_root_page_id); // Delete old root page
                 }
                 return true; // Root handled, finish.
             }
@@ -301,9 +676,12 @@ namespace RFlowey {
             // If parent node is underflowed and not root
             if (parent_node->current_size_ <= InnerNode::MERGE_T) {
                 if (parent_node->prev_node_id_ != INVALID_PAGE_ID) {
-                    if (!parent_node->merge(&manager_)) { // Try merge, if fails (e.g. rebalanced)
+                    if (!parent_node->merge(manager_)) { // Try merge, if fails (e.g. rebalanced)
                         return true; // Stop propagation
                     }
+                    if (merged_into) {
+                        merged_into->push_back(first_key<InnerNode>(std::as_const(parent_node)->prev_node_id_));
+                    }
                     // If merge succeeded, continue loop to update grandparent.
                 } else {
                      // No previous sibling for inner node to merge with.
@@ -317,38 +695,107 @@ namespace RFlowey {
       return true;
     }
 
-    sjtu::vector<pair<Key,Value>> range_find(const Key& start_key, const Key& end_key) {
-        sjtu::vector<pair<Key,Value>> result_values;
-        auto find_res = find_pos(start_key, OperationType::FIND);
-        PageRef<LeafNode> current_leaf = std::move(find_res.cur_pos.first);
-        index_type current_idx = find_res.cur_pos.second;
+  public:
 
-        if (!current_leaf.is_valid) return result_values;
+    /**
+     * @brief insert entries sorted by key, equal keys overwrite like insert does.
+     * One descent serves every following key that still belongs to the same leaf and fits without a split.
+     */
+    void bulk_insert(const sjtu::vector<pair<Key,Value>> &sorted) {
+      size_t i = 0;
+      while (i < sorted.size()) {
+        std::optional<Key> upper;
+        PageRef<LeafNode> leaf_ref = PagePtr<LeafNode>{find_leaf(sorted[i].first, &upper), manager_}.get_ref();
+        auto in_leaf = [&](const Key &key) { return !upper || key < *upper; };
+        size_t batch_begin = i;
+        while (i < sorted.size() && in_leaf(sorted[i].first) && std::as_const(leaf_ref)->is_upper_safe()) {
+#ifdef BPT_TEST
+          assert((i == 0 || sorted[i - 1].first <= sorted[i].first) && "bulk_insert input is not sorted");
+#endif
+          const Key &key = sorted[i].first;
+          index_type idx = std::as_const(leaf_ref)->search(key);
+          if (idx != INVALID_PAGE_ID && std::as_const(leaf_ref)->data_[idx].first == key) {
+            leaf_ref->data_[idx].second = sorted[i].second;
+          } else {
+            leaf_ref->insert_at(idx, sorted[i]);
+          }
+          ++i;
+        }
+        leaf_ref.Drop();
+        if constexpr (augmented) {
+          if (i > batch_begin) {
+            refresh_path(sorted[i - 1].first);
+          }
+        }
+        if (i < sorted.size() && in_leaf(sorted[i].first)) {
+          // the leaf is full, the regular path splits it
+          insert(sorted[i].first, sorted[i].second);
+          ++i;
+        }
+      }
+    }
+
+    /**
+     * @brief build the tree bottom-up from entries sorted by key, writing every page exactly once.
+     * Only an empty tree can be bulk loaded, otherwise this is bulk_insert.
+     */
+    void bulk_load(const sjtu::vector<pair<Key,Value>> &sorted) {
+      if (sorted.empty()) {
+        return;
+      }
+      if (!is_empty()) {
+        bulk_insert(sorted);
+        return;
+      }
+      // The leftmost leaf always starts with the {Key{}, Value{}} sentinel
+      sjtu::vector<typename LeafNode::value_type> entries;
+      entries.push_back({Key{}, Value{}});
+      for (size_t i = 0; i < sorted.size(); ++i) {
+#ifdef BPT_TEST
+        assert((i == 0 || sorted[i - 1].first <= sorted[i].first) && "bulk_load input is not sorted");
+#endif
+        if (entries.back().first == sorted[i].first) {
+          entries.back().second = sorted[i].second;
+        } else {
+          entries.push_back(sorted[i]);
+        }
+      }
+
+      page_id_t old_root_id = root_.page_id();
+      page_id_t old_leaf_id = root_.get_const_ref()->at(0).second;
+      manager_->DeletePage(old_leaf_id);
+      manager_->DeletePage(old_root_id);
+
+      sjtu::vector<typename InnerNode::value_type> level = build_level<LeafNode>(entries);
+      layer = -1;
+      do {
+        level = build_level<InnerNode>(level);
+        ++layer;
+      } while (level.size() > 1);
+      root_ = PagePtr<InnerNode>{level[0].second, manager_};
+      save_config();
+    }
 
-        if (current_idx == INVALID_PAGE_ID) {
-            current_idx = 0;
+    bool erase(const Key& key) {
+      if constexpr (augmented) {
+        sjtu::vector<Key> merged_into;
+        if (!erase_impl(key, &merged_into)) {
+          return false;
         }
-        while (current_idx < current_leaf->current_size_ && current_leaf->at(current_idx).first < start_key) {
-            current_idx++;
+        refresh_path(key);
+        for (size_t i = 0; i < merged_into.size(); ++i) {
+          refresh_path(merged_into[i]);
         }
-        while (current_leaf.is_valid) {
-            for (; current_idx < current_leaf->current_size_; ++current_idx) {
-                const auto& item_key = current_leaf->at(current_idx).first;
-                const auto& item_value = current_leaf->at(current_idx).second;
-                if (item_key > end_key) {
-                    return result_values;
-                }
-                result_values.push_back({item_key,item_value});
-            }
+        return true;
+      } else {
+        return erase_impl(key, nullptr);
+      }
+    }
 
-            // Move to next leaf node
-            if (current_leaf->next_node_id_ != INVALID_PAGE_ID) {
-                current_leaf = PagePtr<LeafNode>{current_leaf->next_node_id_, &manager_}.get_ref();
-                current_idx = 0; // Start scanning new leaf from the beginning
-                if (!current_leaf.is_valid) break; // Should not happen if next_node_id_ was valid
-            } else {
-                break; // No more leaf nodes
-            }
+    sjtu::vector<pair<Key,Value>> range_find(const Key& start_key, const Key& end_key) {
+        sjtu::vector<pair<Key,Value>> result_values;
+        for (Cursor it = seek(start_key); it.valid() && it.key() <= end_key; it.next()) {
+            result_values.push_back({it.key(), it.value()});
         }
         return result_values;
     }
@@ -361,9 +808,12 @@ namespace RFlowey {
 
       if (!leaf_ref.is_valid) return false;
 
-      if (index_in_leaf != INVALID_PAGE_ID && index_in_leaf < leaf_ref->current_size_) {
-        if (leaf_ref->data_[index_in_leaf].first == key) {
+      if (index_in_leaf != INVALID_PAGE_ID && index_in_leaf < std::as_const(leaf_ref)->current_size_) {
+        if (std::as_const(leaf_ref)->data_[index_in_leaf].first == key) {
           leaf_ref->data_[index_in_leaf].second = new_value;
+          if constexpr (augmented) {
+            refresh_path(key);
+          }
           return true;
         }
       }
@@ -379,11 +829,14 @@ namespace RFlowey {
       PageRef<LeafNode>& leaf_ref = result.cur_pos.first;
       index_type index_in_leaf = result.cur_pos.second;
 
-      if (leaf_ref.is_valid && index_in_leaf != INVALID_PAGE_ID && index_in_leaf < leaf_ref->current_size_) {
+      if (leaf_ref.is_valid && index_in_leaf != INVALID_PAGE_ID && index_in_leaf < std::as_const(leaf_ref)->current_size_) {
         // Assuming data_ is accessible for modification. For BPTNode, this is data_ array.
-        if (leaf_ref->data_[index_in_leaf].first == key) {
+        if (std::as_const(leaf_ref)->data_[index_in_leaf].first == key) {
           func(leaf_ref->data_[index_in_leaf].second); // Pass Value& to func
           // PageRef destructor handles writing back if dirty.
+          if constexpr (augmented) {
+            refresh_path(key);
+          }
           return true; // Modification occurred
         }
       }
@@ -392,6 +845,7 @@ namespace RFlowey {
 
     bool range_modify(const Key& start_key, const Key& end_key, const std::function<void(Value&)>& func) {
       bool modified = false;
+      [[maybe_unused]] sjtu::vector<Key> touched_leaves; // one modified key per leaf, to refresh summaries
 
       if (root_.page_id() == INVALID_PAGE_ID) {
         return false;
@@ -409,22 +863,23 @@ namespace RFlowey {
       if (current_idx == INVALID_PAGE_ID) {
           current_idx = 0;
       }
-      while (current_idx < current_leaf->current_size_ && current_leaf->at(current_idx).first < start_key) {
+      while (current_idx < std::as_const(current_leaf)->current_size_ && std::as_const(current_leaf)->at(current_idx).first < start_key) {
           current_idx++;
       }
 
-      page_id_t current_leaf_id = current_leaf.is_valid ? current_leaf->self_id_ : INVALID_PAGE_ID;
+      page_id_t current_leaf_id = current_leaf.is_valid ? std::as_const(current_leaf)->self_id_ : INVALID_PAGE_ID;
 
       while (current_leaf_id != INVALID_PAGE_ID) {
-        if (!current_leaf.is_valid || current_leaf->self_id_ != current_leaf_id) {
-            current_leaf = PagePtr<LeafNode>{current_leaf_id, &manager_}.get_ref();
+        if (!current_leaf.is_valid || std::as_const(current_leaf)->self_id_ != current_leaf_id) {
+            current_leaf = PagePtr<LeafNode>{current_leaf_id, manager_}.get_ref();
             if (!current_leaf.is_valid) break;
             current_idx = 0; // Start scanning new leaf from the beginning
         }
 
-        for (; current_idx < current_leaf->current_size_; ++current_idx) {
+        const LeafNode &leaf = *std::as_const(current_leaf);
+        for (; current_idx < leaf.current_size_; ++current_idx) {
           // Use direct access for key comparison
-          if (current_leaf->data_[current_idx].first > end_key) {
+          if (leaf.data_[current_idx].first > end_key) {
             current_leaf_id = INVALID_PAGE_ID; // Signal to stop outer loop
             break; // Stop processing this leaf
           }
@@ -432,9 +887,14 @@ namespace RFlowey {
           // Ensure the key is within the desired range [start_key, end_key]
           // The check for '> end_key' is above.
           // The check for '>= start_key' is important for all elements.
-          if (current_leaf->data_[current_idx].first >= start_key) {
+          if (leaf.data_[current_idx].first >= start_key) {
             // New logic: func(Value&) modifies in place.
             func(current_leaf->data_[current_idx].second);
+            if constexpr (augmented) {
+              if (touched_leaves.empty() || touched_leaves.back() < leaf.data_[0].first) {
+                touched_leaves.push_back(leaf.data_[current_idx].first);
+              }
+            }
             modified = true; // Assume func call implies a modification.
           }
         }
@@ -443,19 +903,100 @@ namespace RFlowey {
             break;
         }
 
-        current_leaf_id = current_leaf->next_node_id_;
+        current_leaf_id = leaf.next_node_id_;
         // current_idx will be reset to 0 if a new leaf is loaded in the next iteration's check.
       }
 
+      if constexpr (augmented) {
+        for (size_t i = 0; i < touched_leaves.size(); ++i) {
+          refresh_path(touched_leaves[i]);
+        }
+      }
       return modified;
     }
 
+    /**
+     * @brief fold the summaries of every entry with key in [lo, hi], O(height) pages are touched
+     */
+    summary_t range_aggregate(const Key &lo, const Key &hi) {
+      static_assert(augmented, "range_aggregate needs an augmented BPT");
+      return aggregate_node(root_.page_id(), 0, lo, hi, std::nullopt, std::nullopt);
+    }
+
+    /**
+     * @brief number of entries with key < key, the Key{} sentinel included; O(height) pages are touched
+     */
+    size_t rank(const Key &key) {
+      static_assert(std::is_same_v<Augment, CountAugment>, "rank needs a BPT augmented with CountAugment");
+      size_t result = 0;
+      page_id_t next_page_id = root_.page_id();
+      for (int i = 0; i <= layer; ++i) {
+        ConstPageRef<InnerNode> node = PagePtr<InnerNode>{next_page_id, manager_}.get_const_ref();
+        index_type idx = node->search(key);
+        if (idx == INVALID_PAGE_ID) {
+          idx = 0;
+        }
+        for (index_type j = 0; j < idx; ++j) {
+          result += node->data_[j].second.summary; // children left of the path only hold smaller keys
+        }
+        next_page_id = node->at(idx).second;
+      }
+      ConstPageRef<LeafNode> leaf = PagePtr<LeafNode>{next_page_id, manager_}.get_const_ref();
+      index_type idx = leaf->search(key);
+      if (idx != INVALID_PAGE_ID) {
+        result += leaf->data_[idx].first < key ? idx + 1 : idx;
+      }
+      return result;
+    }
+
+    /**
+     * @brief the entry at position k (from 0) in key order, the Key{} sentinel being position 0;
+     * O(height) pages are touched
+     */
+    std::optional<pair<Key, Value> > select(size_t k) {
+      static_assert(std::is_same_v<Augment, CountAugment>, "select needs a BPT augmented with CountAugment");
+      page_id_t next_page_id = root_.page_id();
+      for (int i = 0; i <= layer; ++i) {
+        ConstPageRef<InnerNode> node = PagePtr<InnerNode>{next_page_id, manager_}.get_const_ref();
+        index_type j = 0;
+        while (j < node->current_size_ && k >= node->data_[j].second.summary) {
+          k -= node->data_[j].second.summary;
+          ++j;
+        }
+        if (j == node->current_size_) {
+          return std::nullopt;
+        }
+        next_page_id = node->data_[j].second;
+      }
+      ConstPageRef<LeafNode> leaf = PagePtr<LeafNode>{next_page_id, manager_}.get_const_ref();
+      if (k >= leaf->current_size_) {
+        return std::nullopt;
+      }
+      return leaf->data_[k];
+    }
+
+    /**
+     * @brief the k-th entry (from 0) among those with key in [lo, hi]
+     */
+    std::optional<pair<Key, Value> > select(const Key &lo, const Key &hi, size_t k) {
+      auto entry = select(rank(lo) + k);
+      if (!entry || hi < entry->first) {
+        return std::nullopt;
+      }
+      return entry;
+    }
+
+
     void clear() {
-      manager_.Clear(); // Clears all data managed by the disk manager.
+      if (space_ != nullptr) {
+        release_pages(root_.page_id(), 0); // The pool and the file are shared with other trees
+      } else {
+        manager_->Clear(); // Drops every cached frame and clears the disk manager.
+      }
 
       // Re-initialize the BPT to a minimal state, identical to creating a new BPT.
-      PagePtr<InnerNode> new_root_ptr = allocate<InnerNode>(&manager_);
-      PagePtr<LeafNode> first_leaf_ptr = allocate<LeafNode>(&manager_);
+      PagePtr<InnerNode> new_root_ptr = allocate<InnerNode>(manager_);
+      PagePtr<LeafNode> first_leaf_ptr = allocate<LeafNode>(manager_);
 
       this->layer = 0;
       this->root_ = new_root_ptr; // Update root_ to the new root PagePtr
@@ -469,6 +1010,10 @@ namespace RFlowey {
       // InnerNode stores pair<Key, page_id_t>.
       typename InnerNode::value_type initial_root_data[1] = {{Key{}, first_leaf_ptr.page_id()}};
       new_root_ptr.make_ref(InnerNode{new_root_ptr.page_id(), 1, initial_root_data});
+      if constexpr (augmented) {
+        refresh_path(Key{});
+      }
+      save_config();
 
 #ifdef BPT_TEST
       std::cerr << "BPT cleared. New root ID: " << root_.page_id()
@@ -505,7 +1050,7 @@ private:
 
     if (!current_node_is_leaf) { // It's an InnerNode
       try {
-        PageRef<InnerNode> node_ref = PagePtr<InnerNode>{page_id, &manager_}.get_ref();
+        PageRef<InnerNode> node_ref = PagePtr<InnerNode>{page_id, manager_}.get_ref();
         std::cout << indent << "InnerNode (ID: " << node_ref->self_id_
                   << ", Depth: " << current_node_depth
                   << ", Size: " << node_ref->current_size_
@@ -523,7 +1068,7 @@ private:
       }
     } else { // It's a LeafNode
       try {
-        PageRef<LeafNode> node_ref = PagePtr<LeafNode>{page_id, &manager_}.get_ref();
+        PageRef<LeafNode> node_ref = PagePtr<LeafNode>{page_id, manager_}.get_ref();
         std::cout << indent << "LeafNode (ID: " << node_ref->self_id_
                   << ", Depth: " << current_node_depth
                   << ", Size: " << node_ref->current_size_
@@ -3,6 +3,7 @@
 
 #include <optional>
 #include <variant>
+#include <utility>
 
 #include "disk/IO_manager.h"
 #include "disk/IO_utils.h"
@@ -132,7 +133,7 @@ namespace RFlowey {
 #ifdef BPT_TEST
       assert(current_size_>=SPLIT_T);
 #endif
-      std::unique_ptr<BPTNode> temp = std::make_unique<BPTNode>(*this);
+      PageRef<BPTNode> temp = ptr.make_ref(std::as_const(*this));
 
       temp->prev_node_id_ = self_id_;
       temp->next_node_id_ = next_node_id_;
@@ -148,15 +149,15 @@ namespace RFlowey {
       temp->current_size_ = current_size_-mid;
       current_size_ = mid;
 
-      return ptr.make_ref(std::move(temp));
+      return temp;
     }
 
-    bool merge(IOManager* manager) {
+    bool merge(BufferPoolManager* manager) {
 #ifdef BPT_TEST
       assert(prev_node_id_!=INVALID_PAGE_ID);
 #endif
       auto prev_node = PagePtr<BPTNode>{prev_node_id_,manager}.get_ref();
-      if(prev_node->current_size_+current_size_>=SIZEMAX-1) {
+      if(std::as_const(prev_node)->current_size_+current_size_>=SIZEMAX-1) {
         return false;
       }
       if(next_node_id_!=INVALID_PAGE_ID) {
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "common.h"
+
+namespace RFlowey {
+  /**
+   * Augmentation policy of BPT, the default: inner nodes only store child page ids.
+   *
+   * An augmenting policy keeps a monoid summary next to every child pointer and provides
+   *   using summary_type = ...;   trivially copyable, with operator==
+   *   static summary_type identity();
+   *   static summary_type lift(const Key&, const Value&);
+   *   static summary_type combine(const summary_type&, const summary_type&);
+   * Range updates go through range_modify, which refreshes the summaries above the touched leaves.
+   */
+  struct NoAugment {
+  };
+
+  /**
+   * Subtree sizes, for the order statistics BPT::rank and BPT::select.
+   */
+  struct CountAugment {
+    using summary_type = size_t;
+
+    static summary_type identity() {
+      return 0;
+    }
+    template<typename Key, typename Value>
+    static summary_type lift(const Key &, const Value &) {
+      return 1;
+    }
+    static summary_type combine(const summary_type &a, const summary_type &b) {
+      return a + b;
+    }
+  };
+
+  /**
+   * Child slot of an augmented inner node, converts to and from the plain page id
+   * so the tree code that only routes keys does not need to know about the summary.
+   */
+  template<typename Summary>
+  struct SummarizedChild {
+    page_id_t page_id = INVALID_PAGE_ID;
+    Summary summary{};
+
+    SummarizedChild() = default;
+    SummarizedChild(page_id_t id) : page_id(id) {// NOLINT(google-explicit-constructor)
+    }
+    SummarizedChild(page_id_t id, const Summary &s) : page_id(id), summary(s) {
+    }
+    operator page_id_t() const {// NOLINT(google-explicit-constructor)
+      return page_id;
+    }
+  };
+
+  template<typename Augment>
+  struct AugmentTraits {
+    static constexpr bool enabled = true;
+    using summary_type = typename Augment::summary_type;
+    using child_type = SummarizedChild<summary_type>;
+  };
+
+  template<>
+  struct AugmentTraits<NoAugment> {
+    static constexpr bool enabled = false;
+    using summary_type = NoAugment;
+    using child_type = page_id_t;
+  };
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 
 namespace RFlowey {
 
@@ -10,11 +11,21 @@ namespace RFlowey {
 
   constexpr float SPLIT_RATE = 3.0 / 4;
   constexpr float MERGE_RATE = 1.0 / 4;
+  constexpr float BULK_FILL_RATE = 0.7;//leaf/inner fill of bulk_load, below SPLIT_RATE so later inserts don't split at once
   using index_type = unsigned long;
   constexpr int PAGESIZE = 4096;
   constexpr page_id_t INVALID_PAGE_ID=-1;
   constexpr size_t LRU_K = 5;
-  constexpr size_t DISK_PAGE_CONFIG_ID=1;
+  constexpr size_t BUFFER_POOL_SIZE = 512;//frames per tree
+  constexpr size_t DISK_EXTENT_PAGES = 256;//files are grown/preallocated 1MB at a time
+  constexpr size_t DISK_PAGE_CONFIG_ID=1;//never handed out by NewPage, the catalog of a Tablespace
+  constexpr size_t TABLESPACE_POOL_SIZE = 5 * BUFFER_POOL_SIZE;//shared by every tree of a tablespace
+  constexpr size_t BLOOM_EXPECTED_KEYS = 1 << 17;//keys a hashed map's filter is sized for
+  constexpr size_t BLOOM_BITS_PER_KEY = 10;
+  constexpr size_t WAL_GROUP_COMMANDS = 4096;//commands per group commit at most
+  constexpr long WAL_GROUP_MS = 1000;//age of the oldest uncommitted command at most
+  constexpr size_t WAL_CHECKPOINT_BYTES = 64 << 20;//log length that triggers a checkpoint
+  constexpr size_t WAL_BUFFER_BYTES = 1 << 20;//records are handed to the kernel in chunks of this size
   //Global manager for Disk(unused)
   //inline IOManager* manager;
 
@@ -1,10 +1,23 @@
 #include "IO_manager.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "IO_utils.h"
+#include "durability.h"
+#include "wal.h"
 
 
 namespace RFlowey {
 
   IOManager::~IOManager() = default;
+  bool IOManager::IsLogged() const {
+    return false;
+  }
 
   //--------Memory version-------
   MemoryManager::MemoryManager(const std::string &file_name) {
@@ -12,44 +25,100 @@ namespace RFlowey {
   }
 
   page_id_t MemoryManager::NewPage() {
-    return ++next_page_;
+    if(meta_.free_head != 0) {
+      page_id_t page_id = meta_.free_head;
+      std::memcpy(&meta_.free_head,memory_+page_id*PAGESIZE,sizeof(page_id_t));
+      --meta_.free_count;
+      return page_id;
+    }
+    return ++meta_.next_page;
   }
   void MemoryManager::DeletePage(page_id_t page_id) {
-    return;
+    std::memcpy(memory_+page_id*PAGESIZE,&meta_.free_head,sizeof(page_id_t));
+    meta_.free_head = page_id;
+    ++meta_.free_count;
   }
-  std::shared_ptr<Page> MemoryManager::ReadPage(page_id_t page_id) {
-    auto temp = std::make_shared<Page>(this,page_id);
-    std::memcpy(temp->get_data(),memory_+page_id*PAGESIZE,PAGESIZE);
-    return temp;
+  void MemoryManager::ReadPage(page_id_t page_id,char* data) {
+    std::memcpy(data,memory_+page_id*PAGESIZE,PAGESIZE);
   }
-  void MemoryManager::WritePage(Page &page, page_id_t page_id) {
-    std::memcpy(memory_+page_id*PAGESIZE,page.get_data(),PAGESIZE);
+  void MemoryManager::WritePage(page_id_t page_id,const char* data) {
+    std::memcpy(memory_+page_id*PAGESIZE,data,PAGESIZE);
   };
 
   void MemoryManager::Clear() {
-    next_page_ = 1;
+    long user_version = meta_.user_version;
+    meta_ = DiskMeta{};
+    meta_.user_version = user_version;
+  }
+  size_t MemoryManager::FreePageCount() const {
+    return meta_.free_count;
+  }
+  size_t MemoryManager::UsedPageCount() const {
+    return meta_.next_page - 1 - meta_.free_count;
+  }
+  long MemoryManager::GetUserVersion() const {
+    return meta_.user_version;
+  }
+  void MemoryManager::SetUserVersion(long version) {
+    meta_.user_version = version;
   }
 
   //--------Disk version-------
-  SimpleDiskManager::SimpleDiskManager(const std::string& file_name) {
+  SimpleDiskManager::SimpleDiskManager(const std::string& file_name) : file_name_(file_name) {
     is_new = open(file_,file_name);
     if(!is_new) {
-      auto meta = SimpleDiskManager::ReadPage(0);
-      next_page_ = *reinterpret_cast<page_id_t*>(meta->get_data());
+      file_.seekg(0);
+      file_.read(reinterpret_cast<char*>(&meta_),sizeof(DiskMeta));
+      if(!file_) {
+        file_.clear();
+        if(file_.gcount() < static_cast<std::streamsize>(sizeof(page_id_t))) {//empty file left by an interrupted run
+          meta_ = DiskMeta{};
+        } else {//older header without the free list
+          meta_.free_head = 0;
+          meta_.free_count = 0;
+          meta_.user_version = 0;
+        }
+      }
     }
   };
   SimpleDiskManager::~SimpleDiskManager(){
     file_.seekp(0);
-    file_.write(reinterpret_cast<const char*>(&next_page_),sizeof(page_id_t));
+    file_.write(reinterpret_cast<const char*>(&meta_),sizeof(DiskMeta));
+    file_.flush();
+    sync_path(file_name_);
+  }
+
+  page_id_t SimpleDiskManager::read_link(page_id_t page_id) {
+    page_id_t next = 0;
+    file_.seekg(static_cast<std::streamoff>(page_id) * PAGESIZE);
+    file_.read(reinterpret_cast<char*>(&next),sizeof(page_id_t));
+    return next;
+  }
+  void SimpleDiskManager::write_link(page_id_t page_id,page_id_t next) {
+    file_.seekp(static_cast<std::streamoff>(page_id) * PAGESIZE);
+    file_.write(reinterpret_cast<const char*>(&next),sizeof(page_id_t));
   }
 
   page_id_t SimpleDiskManager::NewPage() {
-    return ++next_page_;
+    if(meta_.free_head != 0) {
+      page_id_t page_id = meta_.free_head;
+      meta_.free_head = read_link(page_id);
+      --meta_.free_count;
+      return page_id;
+    }
+    return ++meta_.next_page;
   }
   void SimpleDiskManager::DeletePage(page_id_t page_id) {
-    return;
+#ifdef BPT_TEST
+    if (page_id <= 0 || page_id > meta_.next_page) {
+        throw std::out_of_range("SimpleDiskManager: Invalid page_id for DeletePage: " + std::to_string(page_id));
+    }
+#endif
+    write_link(page_id,meta_.free_head);
+    meta_.free_head = page_id;
+    ++meta_.free_count;
   }
-  std::shared_ptr<Page> SimpleDiskManager::ReadPage(page_id_t page_id) {
+  void SimpleDiskManager::ReadPage(page_id_t page_id,char* page_data) {
 #ifdef BPT_TEST
     if (!file_.is_open()) {
         throw std::runtime_error("SimpleDiskManager: File is not open for reading.");
@@ -59,8 +128,6 @@ namespace RFlowey {
     }
 #endif
 
-    auto temp = std::make_shared<Page>(this, page_id);
-    char* page_data = temp->get_data();
     std::streamoff offset = static_cast<std::streamoff>(page_id) * PAGESIZE;
 
     file_.seekg(offset);
@@ -82,11 +149,9 @@ namespace RFlowey {
                                  std::to_string(PAGESIZE) + (eof_reached ? ". EOF reached." : ". I/O error."));
     }
 #endif
-
-    return temp;
   }
 
-  void SimpleDiskManager::WritePage(Page& page, page_id_t page_id) {
+  void SimpleDiskManager::WritePage(page_id_t page_id,const char* page_data) {
 #ifdef BPT_TEST
     if (!file_.is_open()) {
         throw std::runtime_error("SimpleDiskManager: File is not open for writing.");
@@ -95,7 +160,6 @@ namespace RFlowey {
         throw std::out_of_range("SimpleDiskManager: Invalid page_id for WritePage (must be > 0): " + std::to_string(page_id));
     }
 #endif
-    char* page_data = page.get_data();
     std::streamoff offset = static_cast<std::streamoff>(page_id) * PAGESIZE;
 
     file_.seekp(offset);
@@ -115,7 +179,387 @@ namespace RFlowey {
 #endif
   }
   void SimpleDiskManager::Clear() {
-    next_page_ = 1;
+    long user_version = meta_.user_version;
+    meta_ = DiskMeta{};
+    meta_.user_version = user_version;
+  }
+  size_t SimpleDiskManager::FreePageCount() const {
+    return meta_.free_count;
+  }
+  size_t SimpleDiskManager::UsedPageCount() const {
+    return meta_.next_page - 1 - meta_.free_count;
+  }
+  long SimpleDiskManager::GetUserVersion() const {
+    return meta_.user_version;
+  }
+  void SimpleDiskManager::SetUserVersion(long version) {
+    meta_.user_version = version;
+  }
+
+
+  //--------mmap version-------
+  MmapDiskManager::MmapDiskManager(const std::string& file_name) {
+    fd_ = ::open(file_name.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd_ < 0) {
+      throw std::runtime_error("MmapDiskManager: cannot open " + file_name);
+    }
+    struct stat st{};
+    ::fstat(fd_, &st);
+    is_new = st.st_size < static_cast<off_t>(sizeof(page_id_t));
+    ensure_mapped(0);
+    if(is_new) {
+      meta() = DiskMeta{};
+    }
+  }
+
+  MmapDiskManager::~MmapDiskManager() {
+    if(data_ != nullptr) {
+      sync_mapping(data_, mapped_size_);
+      ::munmap(data_, mapped_size_);
+    }
+    if(fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  void MmapDiskManager::ensure_mapped(page_id_t page_id) {
+    size_t required = static_cast<size_t>(page_id + 1) * PAGESIZE;
+    if(required <= mapped_size_) {
+      return;
+    }
+    constexpr size_t extent = DISK_EXTENT_PAGES * PAGESIZE;
+    size_t new_size = (required + extent - 1) / extent * extent;
+    struct stat st{};
+    ::fstat(fd_, &st);
+    if(static_cast<size_t>(st.st_size) < new_size && ::ftruncate(fd_, static_cast<off_t>(new_size)) != 0) {
+      throw std::runtime_error("MmapDiskManager: cannot grow file");
+    }
+    if(data_ != nullptr) {
+      ::munmap(data_, mapped_size_);
+    }
+    void* addr = ::mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if(addr == MAP_FAILED) {
+      data_ = nullptr;
+      mapped_size_ = 0;
+      throw std::runtime_error("MmapDiskManager: mmap failed");
+    }
+    data_ = static_cast<char*>(addr);
+    mapped_size_ = new_size;
+  }
+
+  page_id_t MmapDiskManager::NewPage() {
+    DiskMeta& m = meta();
+    if(m.free_head != 0) {
+      page_id_t page_id = m.free_head;
+      std::memcpy(&m.free_head, data_ + page_id * PAGESIZE, sizeof(page_id_t));
+      --m.free_count;
+      return page_id;
+    }
+    page_id_t page_id = m.next_page + 1;
+    ensure_mapped(page_id);//may remap, meta() must be re-read afterwards
+    meta().next_page = page_id;
+    return page_id;
+  }
+  void MmapDiskManager::DeletePage(page_id_t page_id) {
+    DiskMeta& m = meta();
+    std::memcpy(data_ + page_id * PAGESIZE, &m.free_head, sizeof(page_id_t));
+    m.free_head = page_id;
+    ++m.free_count;
+  }
+  void MmapDiskManager::ReadPage(page_id_t page_id,char* page_data) {
+#ifdef BPT_TEST
+    if (page_id <= 0 || static_cast<size_t>(page_id + 1) * PAGESIZE > mapped_size_) {
+        throw std::out_of_range("MmapDiskManager: Invalid page_id for ReadPage: " + std::to_string(page_id));
+    }
+#endif
+    std::memcpy(page_data, data_ + page_id * PAGESIZE, PAGESIZE);
+  }
+  void MmapDiskManager::WritePage(page_id_t page_id,const char* page_data) {
+#ifdef BPT_TEST
+    if (page_id <= 0 || static_cast<size_t>(page_id + 1) * PAGESIZE > mapped_size_) {
+        throw std::out_of_range("MmapDiskManager: Invalid page_id for WritePage: " + std::to_string(page_id));
+    }
+#endif
+    std::memcpy(data_ + page_id * PAGESIZE, page_data, PAGESIZE);
+  }
+  void MmapDiskManager::Clear() {
+    long user_version = meta().user_version;
+    meta() = DiskMeta{};
+    meta().user_version = user_version;
+  }
+  size_t MmapDiskManager::FreePageCount() const {
+    return meta().free_count;
+  }
+  size_t MmapDiskManager::UsedPageCount() const {
+    return meta().next_page - 1 - meta().free_count;
+  }
+  long MmapDiskManager::GetUserVersion() const {
+    return meta().user_version;
+  }
+  void MmapDiskManager::SetUserVersion(long version) {
+    meta().user_version = version;
   }
 
-}
\ No newline at end of file
+  //--------pread/pwrite version-------
+  PosixDiskManager::PosixDiskManager(const std::string& file_name, bool random_access) {
+    fd_ = ::open(file_name.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd_ < 0) {
+      throw std::runtime_error("PosixDiskManager: cannot open " + file_name);
+    }
+    struct stat st{};
+    ::fstat(fd_, &st);
+    reserved_pages_ = static_cast<page_id_t>(st.st_size / PAGESIZE);
+    ssize_t n = ::pread(fd_, &meta_, sizeof(DiskMeta), 0);
+    is_new = n < static_cast<ssize_t>(sizeof(page_id_t));
+    if(is_new) {
+      meta_ = DiskMeta{};
+    } else if(n < static_cast<ssize_t>(sizeof(DiskMeta))) {//older header without the free list
+      meta_.free_head = 0;
+      meta_.free_count = 0;
+      meta_.user_version = 0;
+    }
+    if(random_access) {
+      ::posix_fadvise(fd_, 0, 0, POSIX_FADV_RANDOM);
+    }
+  }
+
+  PosixDiskManager::~PosixDiskManager() {
+    if(fd_ >= 0) {
+      ::pwrite(fd_, &meta_, sizeof(DiskMeta), 0);
+      sync_fd(fd_);
+      ::close(fd_);
+    }
+  }
+
+  void PosixDiskManager::reserve(page_id_t page_id) {
+    if(page_id < reserved_pages_) {
+      return;
+    }
+    page_id_t target = (page_id / static_cast<page_id_t>(DISK_EXTENT_PAGES) + 1) * static_cast<page_id_t>(DISK_EXTENT_PAGES);
+    //only a hint, pwrite still extends the file on filesystems without fallocate
+    ::posix_fallocate(fd_, static_cast<off_t>(reserved_pages_) * PAGESIZE,
+                      static_cast<off_t>(target - reserved_pages_) * PAGESIZE);
+    reserved_pages_ = target;
+  }
+
+  page_id_t PosixDiskManager::read_link(page_id_t page_id) const {
+    page_id_t next = 0;
+    if(::pread(fd_, &next, sizeof(page_id_t), static_cast<off_t>(page_id) * PAGESIZE) != static_cast<ssize_t>(sizeof(page_id_t))) {
+      throw std::runtime_error("PosixDiskManager: Failed to read the free list at page " + std::to_string(page_id));
+    }
+    return next;
+  }
+  void PosixDiskManager::write_link(page_id_t page_id,page_id_t next) {
+    if(::pwrite(fd_, &next, sizeof(page_id_t), static_cast<off_t>(page_id) * PAGESIZE) != static_cast<ssize_t>(sizeof(page_id_t))) {
+      throw std::runtime_error("PosixDiskManager: Failed to write the free list at page " + std::to_string(page_id));
+    }
+  }
+
+  page_id_t PosixDiskManager::NewPage() {
+    if(meta_.free_head != 0) {
+      page_id_t page_id = meta_.free_head;
+      meta_.free_head = read_link(page_id);
+      --meta_.free_count;
+      return page_id;
+    }
+    reserve(++meta_.next_page);
+    return meta_.next_page;
+  }
+  void PosixDiskManager::DeletePage(page_id_t page_id) {
+#ifdef BPT_TEST
+    if (page_id <= 0 || page_id > meta_.next_page) {
+        throw std::out_of_range("PosixDiskManager: Invalid page_id for DeletePage: " + std::to_string(page_id));
+    }
+#endif
+    write_link(page_id,meta_.free_head);
+    meta_.free_head = page_id;
+    ++meta_.free_count;
+  }
+  void PosixDiskManager::ReadPage(page_id_t page_id,char* page_data) {
+#ifdef BPT_TEST
+    if (page_id <= 0) { // Page 0 is reserved/invalid
+        throw std::out_of_range("PosixDiskManager: Invalid page_id for ReadPage (must be > 0): " + std::to_string(page_id));
+    }
+#endif
+    ssize_t n = ::pread(fd_, page_data, PAGESIZE, static_cast<off_t>(page_id) * PAGESIZE);
+    if(n < 0 || (n < PAGESIZE && page_id < meta_.next_page)) {
+      throw std::runtime_error("PosixDiskManager: Failed to read page " + std::to_string(page_id));
+    }
+    if(n < PAGESIZE) {//never written, past the end of the file
+      std::memset(page_data + n, 0, PAGESIZE - n);
+    }
+  }
+  void PosixDiskManager::WritePage(page_id_t page_id,const char* page_data) {
+#ifdef BPT_TEST
+    if (page_id <= 0) { // Page 0 is reserved/invalid
+        throw std::out_of_range("PosixDiskManager: Invalid page_id for WritePage (must be > 0): " + std::to_string(page_id));
+    }
+#endif
+    ssize_t n = ::pwrite(fd_, page_data, PAGESIZE, static_cast<off_t>(page_id) * PAGESIZE);
+    if(n != PAGESIZE) {
+      throw std::runtime_error("PosixDiskManager: Failed to write page " + std::to_string(page_id));
+    }
+  }
+  void PosixDiskManager::Clear() {
+    long user_version = meta_.user_version;
+    meta_ = DiskMeta{};
+    meta_.user_version = user_version;
+  }
+  size_t PosixDiskManager::FreePageCount() const {
+    return meta_.free_count;
+  }
+  size_t PosixDiskManager::UsedPageCount() const {
+    return meta_.next_page - 1 - meta_.free_count;
+  }
+  long PosixDiskManager::GetUserVersion() const {
+    return meta_.user_version;
+  }
+  void PosixDiskManager::SetUserVersion(long version) {
+    meta_.user_version = version;
+  }
+
+  //--------write-ahead logged version-------
+  LoggedDiskManager::LoggedDiskManager(const std::string& file_name) : logged_mode_(durability_logged()) {
+    slot_ = WriteAheadLog::instance().attach(this, file_name);//recovers the file on first use
+    fd_ = ::open(file_name.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd_ < 0) {
+      throw std::runtime_error("LoggedDiskManager: cannot open " + file_name);
+    }
+    ssize_t n = ::pread(fd_, &meta_, sizeof(DiskMeta), 0);
+    is_new = n < static_cast<ssize_t>(sizeof(page_id_t));
+    if(is_new) {
+      meta_ = DiskMeta{};
+    } else if(n < static_cast<ssize_t>(sizeof(DiskMeta))) {//older header without the free list
+      meta_.free_head = 0;
+      meta_.free_count = 0;
+      meta_.user_version = 0;
+    }
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_RANDOM);
+  }
+
+  //with the log the header is not written here, a half finished command must not reach the file
+  LoggedDiskManager::~LoggedDiskManager() {
+    WriteAheadLog::instance().detach(this);
+    if(fd_ >= 0) {
+      if(!logged_mode_) {
+        ::pwrite(fd_, &meta_, sizeof(DiskMeta), 0);
+      }
+      ::close(fd_);
+    }
+  }
+
+  page_id_t LoggedDiskManager::read_link(page_id_t page_id) {
+    char page[PAGESIZE];
+    ReadPage(page_id, page);
+    page_id_t next;
+    std::memcpy(&next, page, sizeof(page_id_t));
+    return next;
+  }
+  void LoggedDiskManager::write_link(page_id_t page_id,page_id_t next) {
+    char page[PAGESIZE];
+    ReadPage(page_id, page);
+    std::memcpy(page, &next, sizeof(page_id_t));
+    WritePage(page_id, page);
+  }
+
+  page_id_t LoggedDiskManager::NewPage() {
+    if(meta_.free_head != 0) {
+      page_id_t page_id = meta_.free_head;
+      meta_.free_head = read_link(page_id);
+      --meta_.free_count;
+      return page_id;
+    }
+    return ++meta_.next_page;
+  }
+  void LoggedDiskManager::DeletePage(page_id_t page_id) {
+#ifdef BPT_TEST
+    if (page_id <= 0 || page_id > meta_.next_page) {
+        throw std::out_of_range("LoggedDiskManager: Invalid page_id for DeletePage: " + std::to_string(page_id));
+    }
+#endif
+    write_link(page_id,meta_.free_head);
+    meta_.free_head = page_id;
+    ++meta_.free_count;
+  }
+  void LoggedDiskManager::ReadPage(page_id_t page_id,char* page_data) {
+    if(static_cast<size_t>(page_id) < logged_.size() && logged_[page_id] >= 0) {
+      WriteAheadLog::instance().read(logged_[page_id], page_data, PAGESIZE);
+      return;
+    }
+    ssize_t n = ::pread(fd_, page_data, PAGESIZE, static_cast<off_t>(page_id) * PAGESIZE);
+    if(n < 0) {
+      throw std::runtime_error("LoggedDiskManager: Failed to read page " + std::to_string(page_id));
+    }
+    //never written: past the end of the file, or handed out and freed before it was ever flushed
+    if(n < PAGESIZE) {
+      std::memset(page_data + n, 0, PAGESIZE - n);
+    }
+  }
+  void LoggedDiskManager::WritePage(page_id_t page_id,const char* page_data) {
+#ifdef BPT_TEST
+    if (page_id <= 0) { // Page 0 is reserved/invalid
+        throw std::out_of_range("LoggedDiskManager: Invalid page_id for WritePage (must be > 0): " + std::to_string(page_id));
+    }
+#endif
+    if(!logged_mode_) {
+      if(::pwrite(fd_, page_data, PAGESIZE, static_cast<off_t>(page_id) * PAGESIZE) != PAGESIZE) {
+        throw std::runtime_error("LoggedDiskManager: Failed to write page " + std::to_string(page_id));
+      }
+      return;
+    }
+    off_t offset = WriteAheadLog::instance().append_page(slot_, page_id, page_data);
+    if(static_cast<size_t>(page_id) >= logged_.size()) {
+      size_t grown = logged_.size() * 2;
+      logged_.resize(grown > static_cast<size_t>(page_id) ? grown : static_cast<size_t>(page_id) + 1, -1);
+    }
+    if(logged_[page_id] < 0) {
+      ++logged_pages_;
+    }
+    logged_[page_id] = offset;
+  }
+  void LoggedDiskManager::Clear() {
+    long user_version = meta_.user_version;
+    meta_ = DiskMeta{};
+    meta_.user_version = user_version;
+  }
+  size_t LoggedDiskManager::FreePageCount() const {
+    return meta_.free_count;
+  }
+  size_t LoggedDiskManager::UsedPageCount() const {
+    return meta_.next_page - 1 - meta_.free_count;
+  }
+  long LoggedDiskManager::GetUserVersion() const {
+    return meta_.user_version;
+  }
+  void LoggedDiskManager::SetUserVersion(long version) {
+    meta_.user_version = version;
+  }
+  bool LoggedDiskManager::IsLogged() const {
+    return true;
+  }
+  const DiskMeta& LoggedDiskManager::GetMeta() const {
+    return meta_;
+  }
+  bool LoggedDiskManager::HasLoggedPages() const {
+    return logged_pages_ > 0;
+  }
+
+  void LoggedDiskManager::Checkpoint() {
+    char page[PAGESIZE];
+    for(size_t page_id = 0; page_id < logged_.size() && logged_pages_ > 0; ++page_id) {
+      if(logged_[page_id] < 0) {
+        continue;
+      }
+      WriteAheadLog::instance().read(logged_[page_id], page, PAGESIZE);
+      if(::pwrite(fd_, page, PAGESIZE, static_cast<off_t>(page_id) * PAGESIZE) != PAGESIZE) {
+        throw std::runtime_error("LoggedDiskManager: Failed to write page " + std::to_string(page_id));
+      }
+      logged_[page_id] = -1;
+      --logged_pages_;
+    }
+    if(::pwrite(fd_, &meta_, sizeof(DiskMeta), 0) != static_cast<ssize_t>(sizeof(DiskMeta))) {
+      throw std::runtime_error("LoggedDiskManager: Failed to write the header");
+    }
+    sync_fd(fd_);
+  }
+}
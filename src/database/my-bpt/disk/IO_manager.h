@@ -1,12 +1,28 @@
 #pragma once
 
 #include <fstream>
+#include <cstdint>
 #include <memory>
+#include <sys/types.h>
 #include "common.h"
+#include "vector.hpp"
 
 
 namespace RFlowey {
-  class Page;
+
+  /**
+   * Header stored at the start of page 0.
+   * Deleted pages form a singly linked free list: the first bytes of a free page
+   * hold the id of the next free page, 0 ends the list since page 0 is never handed out.
+   * Files written before the free list existed only have next_page, the rest reads as 0.
+   * user_version is never interpreted here, the owner of the file uses it to stamp its format.
+   */
+  struct DiskMeta {
+    page_id_t next_page = 1;//last page id handed out, 0 reserved
+    page_id_t free_head = 0;
+    page_id_t free_count = 0;
+    long user_version = 0;
+  };
 
   class IOManager {
   public:
@@ -14,14 +30,28 @@ namespace RFlowey {
 
     virtual page_id_t NewPage() = 0;
     virtual void DeletePage(page_id_t page_id) = 0;
-    virtual std::shared_ptr<Page> ReadPage(page_id_t page_id) = 0;
-    virtual void WritePage(Page& page,page_id_t page_id) = 0;
+    virtual void ReadPage(page_id_t page_id,char* data) = 0;
+    virtual void WritePage(page_id_t page_id,const char* data) = 0;
     virtual void Clear() = 0;
+
+    [[nodiscard]] virtual size_t FreePageCount() const = 0;
+    [[nodiscard]] virtual size_t UsedPageCount() const = 0;
+
+    /**
+     * @brief format version of the stored values, kept in the header and across Clear
+     */
+    [[nodiscard]] virtual long GetUserVersion() const = 0;
+    virtual void SetUserVersion(long version) = 0;
+
+    /**
+     * @brief whether the WriteAheadLog manages this disk, the buffer pool then joins its commits and checkpoints
+     */
+    [[nodiscard]] virtual bool IsLogged() const;
   };
 
   class MemoryManager:public IOManager {
     char memory_[4*1024*1024]={};
-    page_id_t next_page_=0;
+    DiskMeta meta_;
 
   public:
     bool is_new = true;
@@ -30,14 +60,22 @@ namespace RFlowey {
 
     page_id_t NewPage() override;
     void DeletePage(page_id_t page_id) override;
-    std::shared_ptr<Page> ReadPage(page_id_t page_id) override;
-    void WritePage(Page &page, page_id_t page_id) override;
+    void ReadPage(page_id_t page_id,char* data) override;
+    void WritePage(page_id_t page_id,const char* data) override;
     void Clear() override;
+    [[nodiscard]] size_t FreePageCount() const override;
+    [[nodiscard]] size_t UsedPageCount() const override;
+    [[nodiscard]] long GetUserVersion() const override;
+    void SetUserVersion(long version) override;
   };
 
   class SimpleDiskManager:public IOManager {
     std::fstream file_;
-    page_id_t next_page_=1;//0 reserved
+    std::string file_name_;
+    DiskMeta meta_;
+
+    page_id_t read_link(page_id_t page_id);
+    void write_link(page_id_t page_id,page_id_t next);
 
   public:
     bool is_new = true;
@@ -46,8 +84,131 @@ namespace RFlowey {
 
     page_id_t NewPage() override;
     void DeletePage(page_id_t page_id) override;
-    std::shared_ptr<Page> ReadPage(page_id_t page_id) override;
-    void WritePage(Page& page,page_id_t page_id) override;
+    void ReadPage(page_id_t page_id,char* data) override;
+    void WritePage(page_id_t page_id,const char* data) override;
     void Clear() override;
+    [[nodiscard]] size_t FreePageCount() const override;
+    [[nodiscard]] size_t UsedPageCount() const override;
+    [[nodiscard]] long GetUserVersion() const override;
+    void SetUserVersion(long version) override;
+  };
+
+  /**
+   * Maps the whole file and lets the kernel page cache hold the pages.
+   * Reads and writes are plain memcpy against the mapping, the file grows in
+   * extents of DISK_EXTENT_PAGES pages and DiskMeta lives directly in page 0.
+   * The file layout is the same as SimpleDiskManager's, so either one can open it.
+   */
+  class MmapDiskManager:public IOManager {
+    int fd_ = -1;
+    char* data_ = nullptr;
+    size_t mapped_size_ = 0;
+
+    DiskMeta& meta() { return *reinterpret_cast<DiskMeta*>(data_); }
+    [[nodiscard]] const DiskMeta& meta() const { return *reinterpret_cast<const DiskMeta*>(data_); }
+    /**
+     * @brief grow the file and the mapping so that page_id is addressable
+     * @throw std::runtime_error if the file cannot be resized or mapped
+     */
+    void ensure_mapped(page_id_t page_id);
+
+  public:
+    bool is_new = true;
+    explicit MmapDiskManager(const std::string& file_name);
+    ~MmapDiskManager() override;
+    MmapDiskManager(const MmapDiskManager&) = delete;
+    MmapDiskManager& operator=(const MmapDiskManager&) = delete;
+
+    page_id_t NewPage() override;
+    void DeletePage(page_id_t page_id) override;
+    void ReadPage(page_id_t page_id,char* data) override;
+    void WritePage(page_id_t page_id,const char* data) override;
+    void Clear() override;
+    [[nodiscard]] size_t FreePageCount() const override;
+    [[nodiscard]] size_t UsedPageCount() const override;
+    [[nodiscard]] long GetUserVersion() const override;
+    void SetUserVersion(long version) override;
+  };
+
+  /**
+   * File descriptor based manager, pages are accessed with pread/pwrite at page_id * PAGESIZE
+   * so there is no shared file position and no iostream state.
+   * Space is reserved with posix_fallocate one extent ahead of next_page.
+   */
+  class PosixDiskManager:public IOManager {
+    int fd_ = -1;
+    DiskMeta meta_;
+    page_id_t reserved_pages_ = 0;//pages [0,reserved_pages_) are backed by the file
+
+    page_id_t read_link(page_id_t page_id) const;
+    void write_link(page_id_t page_id,page_id_t next);
+    void reserve(page_id_t page_id);
+
+  public:
+    bool is_new = true;
+    /**
+     * @param random_access hint the kernel that readahead is useless for this file
+     * @throw std::runtime_error if the file cannot be opened
+     */
+    explicit PosixDiskManager(const std::string& file_name, bool random_access = true);
+    ~PosixDiskManager() override;
+    PosixDiskManager(const PosixDiskManager&) = delete;
+    PosixDiskManager& operator=(const PosixDiskManager&) = delete;
+
+    page_id_t NewPage() override;
+    void DeletePage(page_id_t page_id) override;
+    void ReadPage(page_id_t page_id,char* data) override;
+    void WritePage(page_id_t page_id,const char* data) override;
+    void Clear() override;
+    [[nodiscard]] size_t FreePageCount() const override;
+    [[nodiscard]] size_t UsedPageCount() const override;
+    [[nodiscard]] long GetUserVersion() const override;
+    void SetUserVersion(long version) override;
+  };
+
+  /**
+   * Same file layout as PosixDiskManager, but the file is only written by checkpoints.
+   * WritePage appends the image to the WriteAheadLog and remembers where it went, ReadPage prefers
+   * that copy over the file, and the header is logged with every commit. See wal.h.
+   * When the durability mode logs nothing, pages are written in place like PosixDiskManager does.
+   */
+  class LoggedDiskManager:public IOManager {
+    int fd_ = -1;
+    std::uint32_t slot_ = 0;
+    bool logged_mode_;//durability_logged() when the file was opened
+    DiskMeta meta_;
+    sjtu::vector<off_t> logged_;//page_id -> log offset of its latest image, -1 if the file is current
+    size_t logged_pages_ = 0;
+
+    page_id_t read_link(page_id_t page_id);
+    void write_link(page_id_t page_id,page_id_t next);
+
+  public:
+    bool is_new = true;
+    /**
+     * @throw std::runtime_error if the file cannot be opened
+     */
+    explicit LoggedDiskManager(const std::string& file_name);
+    ~LoggedDiskManager() override;
+    LoggedDiskManager(const LoggedDiskManager&) = delete;
+    LoggedDiskManager& operator=(const LoggedDiskManager&) = delete;
+
+    page_id_t NewPage() override;
+    void DeletePage(page_id_t page_id) override;
+    void ReadPage(page_id_t page_id,char* data) override;
+    void WritePage(page_id_t page_id,const char* data) override;
+    void Clear() override;
+    [[nodiscard]] size_t FreePageCount() const override;
+    [[nodiscard]] size_t UsedPageCount() const override;
+    [[nodiscard]] long GetUserVersion() const override;
+    void SetUserVersion(long version) override;
+    [[nodiscard]] bool IsLogged() const override;
+
+    [[nodiscard]] const DiskMeta& GetMeta() const;
+    [[nodiscard]] bool HasLoggedPages() const;
+    /**
+     * @brief copy the logged pages and the header into the file and fsync it, every logged image must be committed
+     */
+    void Checkpoint();
   };
 }
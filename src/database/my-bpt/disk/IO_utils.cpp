@@ -1,26 +1,19 @@
 #include "IO_utils.h"
 
-#include <utility>
-#include "IO_manager.h"
-#include "serialize.h"
-
 namespace RFlowey {
-  Page::Page(IOManager* manager,page_id_t page_id):manager_(manager), page_id_(page_id){};
-
-  Page::~Page() {
-    flush();
-  };
-
   char* Page::get_data() {
     return data_;
   }
-  void Page::flush() {
-    if(manager_) {
-      manager_->WritePage(*this,page_id_);
-    }
+  const char* Page::get_data() const {
+    return data_;
+  }
+  page_id_t Page::get_page_id() const {
+    return page_id_;
+  }
+  int Page::get_pin_count() const {
+    return pin_count_;
+  }
+  bool Page::is_dirty() const {
+    return is_dirty_;
   }
-
-
-
 }
-
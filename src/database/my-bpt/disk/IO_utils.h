@@ -3,29 +3,17 @@
 
 #include <fstream>
 #include <memory>
+#include <new>
+#include <utility>
 
 #include "serialize.h"
 #include "IO_manager.h"
+#include "buffer_pool.h"
+#include "page.h"
 #include "common.h"
 
 
 namespace RFlowey {
-  class IOManager;
-  /**
-   * A wrapper of a Byte Page(Temporary solution for no Buffer Pool)
-   * Ensure the life span covers the value of it
-   */
-  class Page {
-    char data_[4096]={};
-    page_id_t page_id_;
-    IOManager* manager_;
-  public:
-    Page() = delete;
-    Page(IOManager* manager,page_id_t page_id);
-    ~Page();
-    char* get_data();
-    void flush();
-  };
   bool open(std::fstream& file,std::string& filename);
 
 
@@ -49,17 +37,21 @@ namespace RFlowey {
   //不要问为啥不分开,问就是模板类
 
 
-  //代表“解引用”后的内存中的对象，析构时会同时析构并重新序列化管理的对象
+  //直接指向被pin住的帧中的对象，不做任何拷贝；析构时解除pin，只有经过非const访问才会标记为脏页
   template<typename T>
   class PageRef {
-    std::shared_ptr<Page> page_;
-    std::unique_ptr<T> t_ptr_;
+    BufferPoolManager* manager_ = nullptr;
+    Page* page_ = nullptr;
+    T* t_ptr_ = nullptr;
     bool is_dirty = false;
   public:
     bool is_valid = true;
     PageRef() = default;
-    PageRef(std::shared_ptr<Page> page,std::unique_ptr<T>&& t_ptr):page_(std::move(page)),t_ptr_(std::move(t_ptr)){};
-    PageRef(PageRef&& ref) noexcept :page_(std::move(ref.page_)),t_ptr_(std::move(ref.t_ptr_)) {
+    PageRef(BufferPoolManager* manager,Page* page,T* t_ptr,bool dirty = false)
+      :manager_(manager),page_(page),t_ptr_(t_ptr),is_dirty(dirty){};
+    PageRef(PageRef&& ref) noexcept :manager_(ref.manager_),page_(ref.page_),t_ptr_(ref.t_ptr_) {
+      ref.page_ = nullptr;
+      ref.t_ptr_ = nullptr;
       is_dirty = ref.is_dirty;
       is_valid = ref.is_valid;
       ref.is_dirty = false;
@@ -72,8 +64,11 @@ namespace RFlowey {
       }
       Drop();
 
-      page_ = std::move(ref.page_);
-      t_ptr_ = std::move(ref.t_ptr_);
+      manager_ = ref.manager_;
+      page_ = ref.page_;
+      t_ptr_ = ref.t_ptr_;
+      ref.page_ = nullptr;
+      ref.t_ptr_ = nullptr;
       is_dirty = ref.is_dirty;
       is_valid = ref.is_valid;
       ref.is_dirty = false;
@@ -89,21 +84,20 @@ namespace RFlowey {
       Drop();
     }
     void Drop() {
-      if(!is_valid) {
+      if(!is_valid || page_ == nullptr) {
         return;
       }
-      if(is_dirty) {
-        Serialize(page_->get_data(),*t_ptr_);
-      }
+      manager_->UnpinPage(page_,is_dirty);
+      page_ = nullptr;
+      t_ptr_ = nullptr;
       is_valid = false;
-
     }
     T* operator->() {
       is_dirty = true;
-      return t_ptr_.get();
+      return t_ptr_;
     }
     const T* operator->() const{
-      return t_ptr_.get();
+      return t_ptr_;
     }
     T& operator*() {
       is_dirty = true;
@@ -113,13 +107,72 @@ namespace RFlowey {
       return *t_ptr_;
     }
   };
+
+  //只读的引用，从不标记为脏页，析构时只解除pin
+  template<typename T>
+  class ConstPageRef {
+    BufferPoolManager* manager_ = nullptr;
+    Page* page_ = nullptr;
+    const T* t_ptr_ = nullptr;
+  public:
+    bool is_valid = true;
+    ConstPageRef() = default;
+    ConstPageRef(BufferPoolManager* manager,Page* page,const T* t_ptr)
+      :manager_(manager),page_(page),t_ptr_(t_ptr){};
+    ConstPageRef(ConstPageRef&& ref) noexcept :manager_(ref.manager_),page_(ref.page_),t_ptr_(ref.t_ptr_) {
+      ref.page_ = nullptr;
+      ref.t_ptr_ = nullptr;
+      is_valid = ref.is_valid;
+      ref.is_valid = false;
+    };
+
+    ConstPageRef& operator=(ConstPageRef&& ref) noexcept {
+      if(this==&ref) {
+        return *this;
+      }
+      Drop();
+
+      manager_ = ref.manager_;
+      page_ = ref.page_;
+      t_ptr_ = ref.t_ptr_;
+      ref.page_ = nullptr;
+      ref.t_ptr_ = nullptr;
+      is_valid = ref.is_valid;
+      ref.is_valid = false;
+
+      return *this;
+    }
+
+    ConstPageRef(const ConstPageRef&) = delete;
+    ConstPageRef& operator=(const ConstPageRef&) = delete;
+
+    ~ConstPageRef() {
+      Drop();
+    }
+    void Drop() {
+      if(!is_valid || page_ == nullptr) {
+        return;
+      }
+      manager_->UnpinPage(page_,false);
+      page_ = nullptr;
+      t_ptr_ = nullptr;
+      is_valid = false;
+    }
+    const T* operator->() const{
+      return t_ptr_;
+    }
+    const T& operator*() const{
+      return *t_ptr_;
+    }
+  };
+
   template<typename T>
   class PagePtr {
   public:
-    IOManager* manager_;
+    BufferPoolManager* manager_;
     page_id_t page_id_;
 
-    explicit PagePtr(page_id_t page_id,IOManager* manager):page_id_(page_id),manager_(manager){}
+    explicit PagePtr(page_id_t page_id,BufferPoolManager* manager):manager_(manager),page_id_(page_id){}
 
     [[nodiscard]] page_id_t page_id() const {
       return page_id_;
@@ -127,25 +180,28 @@ namespace RFlowey {
 
     //get an ref to an EXISTING object on the page;
     [[nodiscard]] PageRef<T> get_ref() const {
-      std::shared_ptr<Page> page = manager_->ReadPage(page_id_);
-      return PageRef{page,Deserialize<T>(page->get_data())};
+      Page* page = manager_->FetchPage(page_id_);
+      return PageRef<T>{manager_,page,View<T>(page->get_data())};
     }
 
-    template<typename... Args>
-    PageRef<T> make_ref(Args ...args) const {
-      return make_ref(std::make_unique<T>(std::forward<Args>(args)...));
+    //read-only access, the frame is never written back because of it
+    [[nodiscard]] ConstPageRef<T> get_const_ref() const {
+      Page* page = manager_->FetchPage(page_id_);
+      return ConstPageRef<T>{manager_,page,View<T>(static_cast<const char*>(page->get_data()))};
     }
-    PageRef<T> make_ref(std::unique_ptr<T> t_obj_ptr) const {
-      auto page = std::make_shared<Page>(manager_, page_id_);
-      Serialize(page->get_data(), *t_obj_ptr);
-      page->flush();
-      return {std::move(page), std::move(t_obj_ptr)};
+
+    //construct the object directly inside the new frame
+    template<typename... Args>
+    PageRef<T> make_ref(Args&& ...args) const {
+      Page* page = manager_->NewPage(page_id_);
+      T* obj = new (page->get_data()) T(std::forward<Args>(args)...);
+      return PageRef<T>{manager_, page, obj, true};
     }
   };
 
   template<typename T>
-  PagePtr<T> allocate(IOManager* manager) {
-    return PagePtr<T>{manager->NewPage(),manager};
+  PagePtr<T> allocate(BufferPoolManager* manager) {
+    return PagePtr<T>{manager->AllocatePage(),manager};
   }
 }
 
@@ -0,0 +1,204 @@
+#include "buffer_pool.h"
+
+#include <cstring>
+#include <stdexcept>
+#include "IO_manager.h"
+#include "wal.h"
+
+namespace RFlowey {
+  BufferPoolManager::BufferPoolManager(size_t pool_size, IOManager* disk)
+    : disk_(disk), pool_size_(pool_size), pages_(new Page[pool_size]), replacer_(pool_size),
+      free_frames_(new frame_id_t[pool_size]) {
+    for (size_t i = 0; i < pool_size_; ++i) {
+      free_frames_[free_size_++] = static_cast<frame_id_t>(pool_size_ - 1 - i);
+    }
+    if (disk_->IsLogged()) {
+      WriteAheadLog::instance().attach_pool(this);
+    }
+  }
+
+  BufferPoolManager::~BufferPoolManager() {
+    FlushAllPages();
+    if (disk_->IsLogged()) {
+      WriteAheadLog::instance().detach_pool(this);
+    }
+    delete[] pages_;
+    delete[] free_frames_;
+    delete[] page_table_;
+  }
+
+  frame_id_t BufferPoolManager::lookup(page_id_t page_id) const {
+    if (page_id < 0 || static_cast<size_t>(page_id) >= table_size_) {
+      return -1;
+    }
+    return page_table_[page_id];
+  }
+
+  void BufferPoolManager::map(page_id_t page_id, frame_id_t frame_id) {
+    if (static_cast<size_t>(page_id) >= table_size_) {
+      size_t new_size = table_size_ == 0 ? 1024 : table_size_;
+      while (new_size <= static_cast<size_t>(page_id)) {
+        new_size *= 2;
+      }
+      auto* new_table = new frame_id_t[new_size];
+      if (table_size_ > 0) {
+        std::memcpy(new_table, page_table_, table_size_ * sizeof(frame_id_t));
+      }
+      for (size_t i = table_size_; i < new_size; ++i) {
+        new_table[i] = -1;
+      }
+      delete[] page_table_;
+      page_table_ = new_table;
+      table_size_ = new_size;
+    }
+    page_table_[page_id] = frame_id;
+  }
+
+  void BufferPoolManager::unmap(page_id_t page_id) {
+    if (page_id >= 0 && static_cast<size_t>(page_id) < table_size_) {
+      page_table_[page_id] = -1;
+    }
+  }
+
+  void BufferPoolManager::write_back(Page& page) {
+    if (page.is_dirty_ && page.page_id_ != INVALID_PAGE_ID) {
+      disk_->WritePage(page.page_id_, page.data_);
+    }
+    page.is_dirty_ = false;
+  }
+
+  frame_id_t BufferPoolManager::acquire_frame() {
+    frame_id_t frame_id;
+    if (free_size_ > 0) {
+      frame_id = free_frames_[--free_size_];
+    } else {
+      if (!replacer_.Evict(&frame_id)) {
+        throw std::runtime_error("BufferPoolManager: all frames are pinned");
+      }
+      Page& victim = pages_[frame_id];
+      write_back(victim);
+      unmap(victim.page_id_);
+    }
+    Page& page = pages_[frame_id];
+    page.page_id_ = INVALID_PAGE_ID;
+    page.pin_count_ = 0;
+    page.is_dirty_ = false;
+    return frame_id;
+  }
+
+  page_id_t BufferPoolManager::AllocatePage() {
+    std::lock_guard<std::mutex> guard(latch_);
+    return disk_->NewPage();
+  }
+
+  Page* BufferPoolManager::NewPage(page_id_t page_id) {
+    std::lock_guard<std::mutex> guard(latch_);
+    frame_id_t frame_id = lookup(page_id);
+    if (frame_id == -1) {
+      frame_id = acquire_frame();
+      map(page_id, frame_id);
+    }
+    Page& page = pages_[frame_id];
+    std::memset(page.data_, 0, PAGESIZE);
+    page.page_id_ = page_id;
+    page.is_dirty_ = true;
+    ++page.pin_count_;
+    replacer_.RecordAccess(frame_id);
+    replacer_.SetEvictable(frame_id, false);
+    return &page;
+  }
+
+  Page* BufferPoolManager::FetchPage(page_id_t page_id) {
+    std::lock_guard<std::mutex> guard(latch_);
+    frame_id_t frame_id = lookup(page_id);
+    if (frame_id == -1) {
+      frame_id = acquire_frame();
+      Page& page = pages_[frame_id];
+      disk_->ReadPage(page_id, page.data_);
+      page.page_id_ = page_id;
+      map(page_id, frame_id);
+    }
+    Page& page = pages_[frame_id];
+    ++page.pin_count_;
+    replacer_.RecordAccess(frame_id);
+    replacer_.SetEvictable(frame_id, false);
+    return &page;
+  }
+
+  void BufferPoolManager::UnpinPage(Page* page, bool is_dirty) {
+    std::lock_guard<std::mutex> guard(latch_);
+#ifdef BPT_TEST
+    if (page->pin_count_ <= 0) {
+      throw std::logic_error("BufferPoolManager::UnpinPage: page is not pinned");
+    }
+#endif
+    auto frame_id = static_cast<frame_id_t>(page - pages_);
+    if (page->page_id_ != INVALID_PAGE_ID) {
+      page->is_dirty_ = page->is_dirty_ || is_dirty;
+    }
+    if (--page->pin_count_ > 0) {
+      return;
+    }
+    if (page->page_id_ == INVALID_PAGE_ID) {//detached by DeletePage while pinned
+      replacer_.Remove(frame_id);
+      free_frames_[free_size_++] = frame_id;
+      return;
+    }
+    replacer_.SetEvictable(frame_id, true);
+  }
+
+  void BufferPoolManager::DeletePage(page_id_t page_id) {
+    std::lock_guard<std::mutex> guard(latch_);
+    frame_id_t frame_id = lookup(page_id);
+    if (frame_id != -1) {
+      unmap(page_id);
+      Page& page = pages_[frame_id];
+      page.page_id_ = INVALID_PAGE_ID;
+      page.is_dirty_ = false;
+      if (page.pin_count_ == 0) {
+        replacer_.Remove(frame_id);
+        free_frames_[free_size_++] = frame_id;
+      }
+    }
+    disk_->DeletePage(page_id);
+  }
+
+  void BufferPoolManager::FlushPage(page_id_t page_id) {
+    std::lock_guard<std::mutex> guard(latch_);
+    frame_id_t frame_id = lookup(page_id);
+    if (frame_id != -1) {
+      write_back(pages_[frame_id]);
+    }
+  }
+
+  void BufferPoolManager::FlushAllPages() {
+    std::lock_guard<std::mutex> guard(latch_);
+    for (size_t i = 0; i < pool_size_; ++i) {
+      write_back(pages_[i]);
+    }
+  }
+
+  void BufferPoolManager::Clear() {
+    std::lock_guard<std::mutex> guard(latch_);
+    for (size_t i = 0; i < pool_size_; ++i) {
+      Page& page = pages_[i];
+      unmap(page.page_id_);
+      page.page_id_ = INVALID_PAGE_ID;
+      page.is_dirty_ = false;
+      if (page.pin_count_ == 0) {
+        replacer_.Remove(static_cast<frame_id_t>(i));
+      }
+    }
+    free_size_ = 0;
+    for (size_t i = 0; i < pool_size_; ++i) {
+      if (pages_[pool_size_ - 1 - i].pin_count_ == 0) {
+        free_frames_[free_size_++] = static_cast<frame_id_t>(pool_size_ - 1 - i);
+      }
+    }
+    disk_->Clear();
+  }
+
+  size_t BufferPoolManager::GetPoolSize() const {
+    return pool_size_;
+  }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include "common.h"
+#include "page.h"
+#include "lru_k_replacer.h"
+
+namespace RFlowey {
+  class IOManager;
+
+  /**
+   * Caches disk pages in a fixed number of pinned frames, replaced by LRU-K.
+   * A frame is only written back when it is evicted or flushed, over a logged disk every WAL commit flushes it.
+   * Every public call holds latch_, so readers on several threads may fetch and unpin concurrently;
+   * the content of a pinned page is not protected.
+   */
+  class BufferPoolManager {
+    std::mutex latch_;
+    IOManager* disk_;
+    size_t pool_size_;
+    Page* pages_;
+    LRUKReplacer replacer_;
+
+    frame_id_t* free_frames_;
+    size_t free_size_ = 0;
+
+    //page_id -> frame_id, page ids are dense so a flat table is enough
+    frame_id_t* page_table_ = nullptr;
+    size_t table_size_ = 0;
+
+    frame_id_t lookup(page_id_t page_id) const;
+    void map(page_id_t page_id, frame_id_t frame_id);
+    void unmap(page_id_t page_id);
+
+    /**
+     * @brief get a clean frame from the free list or by evicting a victim
+     * @throw std::runtime_error when every frame is pinned
+     */
+    frame_id_t acquire_frame();
+    void write_back(Page& page);
+
+  public:
+    BufferPoolManager(size_t pool_size, IOManager* disk);
+    ~BufferPoolManager();
+    BufferPoolManager(const BufferPoolManager&) = delete;
+    BufferPoolManager& operator=(const BufferPoolManager&) = delete;
+
+    /**
+     * @brief reserve a page id on disk without touching the pool
+     */
+    page_id_t AllocatePage();
+
+    /**
+     * @brief pin a zeroed frame for a freshly allocated page, no disk read is done
+     */
+    Page* NewPage(page_id_t page_id);
+
+    /**
+     * @brief pin the frame holding page_id, reading it from disk on a miss
+     */
+    Page* FetchPage(page_id_t page_id);
+
+    void UnpinPage(Page* page, bool is_dirty);
+
+    /**
+     * @brief drop the page from the pool and give it back to the disk manager.
+     * A still pinned frame is detached and recycled once its last pin is released.
+     */
+    void DeletePage(page_id_t page_id);
+
+    void FlushPage(page_id_t page_id);
+    void FlushAllPages();
+
+    /**
+     * @brief forget every cached page without writing back and clear the disk
+     */
+    void Clear();
+
+    [[nodiscard]] size_t GetPoolSize() const;
+  };
+}
@@ -0,0 +1,76 @@
+#include "durability.h"
+
+#include <atomic>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace RFlowey {
+  namespace {
+    Durability mode_ = Durability::Group;
+    std::atomic<size_t> fsyncs_{0};
+  }
+
+  void set_durability(Durability mode) {
+    mode_ = mode;
+  }
+  Durability durability() {
+    return mode_;
+  }
+  bool durability_logged() {
+    return mode_ == Durability::Command || mode_ == Durability::Group;
+  }
+
+  std::optional<Durability> parse_durability(const std::string& name) {
+    if (name == "none") {
+      return Durability::None;
+    }
+    if (name == "exit") {
+      return Durability::Exit;
+    }
+    if (name == "command") {
+      return Durability::Command;
+    }
+    if (name == "group") {
+      return Durability::Group;
+    }
+    return std::nullopt;
+  }
+  const char* durability_name(Durability mode) {
+    switch (mode) {
+      case Durability::None: return "none";
+      case Durability::Exit: return "exit";
+      case Durability::Command: return "command";
+      case Durability::Group: return "group";
+    }
+    return "?";
+  }
+
+  void sync_fd(int fd, bool data_only) {
+    if (mode_ == Durability::None || fd < 0) {
+      return;
+    }
+    data_only ? ::fdatasync(fd) : ::fsync(fd);
+    ++fsyncs_;
+  }
+  void sync_path(const std::string& file_name) {
+    if (mode_ == Durability::None) {
+      return;
+    }
+    int fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      sync_fd(fd);
+      ::close(fd);
+    }
+  }
+  void sync_mapping(void* addr, size_t size) {
+    if (mode_ == Durability::None || addr == nullptr) {
+      return;
+    }
+    ::msync(addr, size, MS_SYNC);
+    ++fsyncs_;
+  }
+  size_t fsync_count() {
+    return fsyncs_;
+  }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+namespace RFlowey {
+
+  /**
+   * How hard the stores try to survive a crash, chosen once at startup.
+   * None:    nothing is logged or fsynced, pages are written in place and the kernel decides when they reach the disk.
+   * Exit:    nothing is logged, every store is flushed and fsynced once when the process shuts down cleanly.
+   * Command: every command is committed to the WriteAheadLog with its own fsync before its output is released.
+   * Group:   commands are committed to the WriteAheadLog in groups, see WriteAheadLog; their output is held until then.
+   * Stores outside the log (PosixDiskManager, SimpleDiskManager, MmapDiskManager) can only sync when they close.
+   */
+  enum class Durability { None, Exit, Command, Group };
+
+  /**
+   * @warning only before the first WriteAheadLog::instance(), the stores read it when they open
+   */
+  void set_durability(Durability mode);
+  [[nodiscard]] Durability durability();
+  /**
+   * @brief whether LoggedDiskManager pages go through the WriteAheadLog
+   */
+  [[nodiscard]] bool durability_logged();
+
+  [[nodiscard]] std::optional<Durability> parse_durability(const std::string& name);
+  [[nodiscard]] const char* durability_name(Durability mode);
+
+  /**
+   * @brief fsync (fdatasync if data_only) unless the mode is None; only issued calls are counted
+   */
+  void sync_fd(int fd, bool data_only = false);
+  void sync_path(const std::string& file_name);
+  void sync_mapping(void* addr, size_t size);
+  [[nodiscard]] size_t fsync_count();
+}
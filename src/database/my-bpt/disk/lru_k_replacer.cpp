@@ -0,0 +1,82 @@
+#include "lru_k_replacer.h"
+
+#include <stdexcept>
+
+namespace RFlowey {
+  LRUKReplacer::LRUKReplacer(size_t num_frames, size_t k)
+    : frames_(new FrameInfo[num_frames]), num_frames_(num_frames), k_(k == 0 || k > LRU_K ? LRU_K : k) {
+  }
+
+  LRUKReplacer::~LRUKReplacer() {
+    delete[] frames_;
+  }
+
+  bool LRUKReplacer::Evict(frame_id_t* frame_id) {
+    if (evictable_size_ == 0) {
+      return false;
+    }
+    frame_id_t victim = -1;
+    bool victim_inf = false;
+    size_t victim_ts = 0;
+    for (size_t i = 0; i < num_frames_; ++i) {
+      const FrameInfo& info = frames_[i];
+      if (!info.evictable) {
+        continue;
+      }
+      // with a full ring the oldest entry is the k-th most recent access,
+      // otherwise it is the first access; either way smaller means older
+      bool inf = info.count < k_;
+      size_t ts = info.history[info.head];
+      if (victim == -1 || (inf && !victim_inf) || (inf == victim_inf && ts < victim_ts)) {
+        victim = static_cast<frame_id_t>(i);
+        victim_inf = inf;
+        victim_ts = ts;
+      }
+    }
+    Remove(victim);
+    *frame_id = victim;
+    return true;
+  }
+
+  void LRUKReplacer::RecordAccess(frame_id_t frame_id) {
+#ifdef BPT_TEST
+    if (frame_id < 0 || static_cast<size_t>(frame_id) >= num_frames_) {
+      throw std::out_of_range("LRUKReplacer::RecordAccess: invalid frame id");
+    }
+#endif
+    FrameInfo& info = frames_[frame_id];
+    ++current_ts_;
+    if (info.count < k_) {
+      info.history[(info.head + info.count) % k_] = current_ts_;
+      ++info.count;
+    } else {
+      info.history[info.head] = current_ts_;
+      info.head = (info.head + 1) % k_;
+    }
+  }
+
+  void LRUKReplacer::SetEvictable(frame_id_t frame_id, bool evictable) {
+    FrameInfo& info = frames_[frame_id];
+    if (info.evictable == evictable) {
+      return;
+    }
+    info.evictable = evictable;
+    if (evictable) {
+      ++evictable_size_;
+    } else {
+      --evictable_size_;
+    }
+  }
+
+  void LRUKReplacer::Remove(frame_id_t frame_id) {
+    FrameInfo& info = frames_[frame_id];
+    if (info.evictable) {
+      --evictable_size_;
+    }
+    info = FrameInfo{};
+  }
+
+  size_t LRUKReplacer::Size() const {
+    return evictable_size_;
+  }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include "common.h"
+
+namespace RFlowey {
+  /**
+   * LRU-K replacement policy over a fixed number of frames.
+   * The victim is the evictable frame with the largest backward k-distance,
+   * frames seen fewer than k times count as +inf and fall back to plain LRU
+   * on their earliest recorded access.
+   */
+  class LRUKReplacer {
+    struct FrameInfo {
+      size_t history[LRU_K]={};//ring buffer of the last k access timestamps
+      size_t head = 0;//oldest recorded access
+      size_t count = 0;
+      bool evictable = false;
+    };
+
+    FrameInfo* frames_;
+    size_t num_frames_;
+    size_t k_;
+    size_t current_ts_ = 0;
+    size_t evictable_size_ = 0;
+
+  public:
+    explicit LRUKReplacer(size_t num_frames, size_t k = LRU_K);
+    ~LRUKReplacer();
+    LRUKReplacer(const LRUKReplacer&) = delete;
+    LRUKReplacer& operator=(const LRUKReplacer&) = delete;
+
+    /**
+     * @brief pick a victim and forget its history
+     * @return false if no frame is evictable
+     */
+    bool Evict(frame_id_t* frame_id);
+    void RecordAccess(frame_id_t frame_id);
+    void SetEvictable(frame_id_t frame_id, bool evictable);
+    void Remove(frame_id_t frame_id);
+    [[nodiscard]] size_t Size() const;
+  };
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include "common.h"
+
+namespace RFlowey {
+  class BufferPoolManager;
+
+  /**
+   * A frame of the buffer pool holding one disk page.
+   * Only BufferPoolManager changes its identity, pin count and dirty flag.
+   */
+  class Page {
+    alignas(std::max_align_t) char data_[PAGESIZE]={};//objects are used in place, see View
+    page_id_t page_id_ = INVALID_PAGE_ID;
+    int pin_count_ = 0;
+    bool is_dirty_ = false;
+
+    friend class BufferPoolManager;
+  public:
+    Page() = default;
+    Page(const Page&) = delete;
+    Page& operator=(const Page&) = delete;
+
+    char* get_data();
+    [[nodiscard]] const char* get_data() const;
+    [[nodiscard]] page_id_t get_page_id() const;
+    [[nodiscard]] int get_pin_count() const;
+    [[nodiscard]] bool is_dirty() const;
+  };
+}
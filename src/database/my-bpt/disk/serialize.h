@@ -4,15 +4,17 @@
 
 #include <cstring>
 #include <memory>
+#include <new>
+#include <cstddef>
+#include <type_traits>
 #include <concepts> // Include for concepts
 // #include "IO_utils.h" // Avoid circular include if possible, maybe forward declare?
 #include "common.h" // Assuming PAGESIZE and page_id_t are here
 
 namespace RFlowey {
   template <typename T>
-  concept PageAble = std::is_trivially_copyable_v<T> && requires {
-    sizeof(T) <= PAGESIZE;
-  };
+  concept PageAble = std::is_trivially_copyable_v<T> && sizeof(T) <= PAGESIZE
+                     && alignof(T) <= alignof(std::max_align_t);
 
   template<typename T>
     requires PageAble<T>
@@ -26,4 +28,16 @@ namespace RFlowey {
     return std::make_unique<T>(*reinterpret_cast<const T*>(_src));
   }
 
+  template<typename T>
+    requires PageAble<T>
+  T* View(void* _src) {//use the object in place, no copy
+    return std::launder(reinterpret_cast<T*>(_src));
+  }
+
+  template<typename T>
+    requires PageAble<T>
+  const T* View(const void* _src) {
+    return std::launder(reinterpret_cast<const T*>(_src));
+  }
+
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+#include "tablespace.h"
+
+#include <iterator>
+#include <stdexcept>
+#include "IO_utils.h"
+
+namespace RFlowey {
+  Tablespace::Tablespace(const std::string &file_name, size_t pool_size)
+    : disk_(file_name), pool_(pool_size, &disk_) {
+    PageRef<Catalog> catalog = PagePtr<Catalog>{DISK_PAGE_CONFIG_ID, &pool_}.get_ref();//a new file reads as zeros
+    if (catalog->magic == 0 && catalog->count == 0) {
+      catalog->magic = CATALOG_MAGIC;
+    } else if (catalog->magic != CATALOG_MAGIC) {
+      throw std::runtime_error("Tablespace: " + file_name + " is not a tablespace of this version");
+    }
+  }
+
+  void Tablespace::read_entry(size_t slot, CatalogEntry &entry) {
+    entry = PagePtr<Catalog>{DISK_PAGE_CONFIG_ID, &pool_}.get_const_ref()->entries[slot];
+  }
+
+  void Tablespace::write_entry(size_t slot, const CatalogEntry &entry) {
+    PagePtr<Catalog>{DISK_PAGE_CONFIG_ID, &pool_}.get_ref()->entries[slot] = entry;
+  }
+
+  size_t Tablespace::open(const std::string &name) {
+    if (name.empty() || name.size() >= NAME_SIZE) {
+      throw std::length_error("Tablespace: bad tree name " + name);
+    }
+    PageRef<Catalog> catalog = PagePtr<Catalog>{DISK_PAGE_CONFIG_ID, &pool_}.get_ref();
+    for (size_t i = 0; i < catalog->count; ++i) {
+      if (name == catalog->entries[i].name) {
+        return i;
+      }
+    }
+    if (catalog->count == std::size(catalog->entries)) {
+      throw std::length_error("Tablespace: catalog is full");
+    }
+    CatalogEntry &entry = catalog->entries[catalog->count];
+    entry = CatalogEntry{};
+    std::memcpy(entry.name, name.data(), name.size());
+    return catalog->count++;
+  }
+}
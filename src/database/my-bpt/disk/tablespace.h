@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include "common.h"
+#include "IO_manager.h"
+#include "buffer_pool.h"
+
+namespace RFlowey {
+
+  /**
+   * Several named trees in one LoggedDiskManager file. They share one buffer pool, so frames go to
+   * whichever tree is hot, and the file's free list, so pages freed by one tree are reused by any other.
+   * Page DISK_PAGE_CONFIG_ID is never handed out by the disk and holds the catalog:
+   * per tree its name and an opaque config owned by the tree (root and layer for BPT).
+   * Only trees can live here, PagedArray needs a file of its own to keep its pages contiguous,
+   * but it keeps its config in the catalog all the same, so it is committed with the trees.
+   */
+  class Tablespace {
+  public:
+    static constexpr size_t NAME_SIZE = 32;
+    static constexpr size_t CONFIG_SIZE = 32;
+    static constexpr std::uint64_t CATALOG_MAGIC = 0x5246545350430003ULL;//"RFTSPC", catalog version 3
+
+  private:
+    struct CatalogEntry {
+      char name[NAME_SIZE];
+      char config[CONFIG_SIZE];
+    };
+
+    struct Catalog {
+      std::uint64_t magic;//0 on a new file
+      size_t count;
+      CatalogEntry entries[(PAGESIZE - sizeof(std::uint64_t) - sizeof(size_t)) / sizeof(CatalogEntry)];
+    };
+
+    LoggedDiskManager disk_;
+    BufferPoolManager pool_;
+
+    void read_entry(size_t slot, CatalogEntry &entry);
+    void write_entry(size_t slot, const CatalogEntry &entry);
+
+  public:
+    /**
+     * @throw std::runtime_error if the file cannot be opened or is not a tablespace of this version
+     */
+    explicit Tablespace(const std::string &file_name, size_t pool_size = TABLESPACE_POOL_SIZE);
+    Tablespace(const Tablespace &) = delete;
+    Tablespace &operator=(const Tablespace &) = delete;
+
+    [[nodiscard]] BufferPoolManager *pool() {
+      return &pool_;
+    }
+
+    /**
+     * @brief find the catalog slot of a tree, adding it with a zeroed config if it is not there yet
+     * @throw std::length_error if the name does not fit or the catalog is full
+     */
+    size_t open(const std::string &name);
+
+    template<typename Config>
+    Config load_config(size_t slot) {
+      static_assert(std::is_trivially_copyable_v<Config> && sizeof(Config) <= CONFIG_SIZE);
+      CatalogEntry entry{};
+      read_entry(slot, entry);
+      Config config;
+      std::memcpy(&config, entry.config, sizeof(Config));
+      return config;
+    }
+
+    template<typename Config>
+    void store_config(size_t slot, const Config &config) {
+      static_assert(std::is_trivially_copyable_v<Config> && sizeof(Config) <= CONFIG_SIZE);
+      CatalogEntry entry{};
+      read_entry(slot, entry);
+      std::memcpy(entry.config, &config, sizeof(Config));
+      write_entry(slot, entry);
+    }
+  };
+}
@@ -0,0 +1,424 @@
+#include "wal.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include "IO_manager.h"
+#include "buffer_pool.h"
+#include "map.hpp"
+
+namespace RFlowey {
+  namespace {
+    constexpr char LOG_MAGIC[8] = {'R', 'F', 'W', 'A', 'L', 0, 0, 1};
+
+    std::uint64_t fnv1a(std::uint64_t hash, const char* data, size_t size) {
+      for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+      }
+      return hash;
+    }
+
+    template<typename Header>
+    std::uint64_t checksum(Header header, const char* payload) {
+      header.checksum = 0;
+      std::uint64_t hash = fnv1a(14695981039346656037ULL, reinterpret_cast<const char*>(&header), sizeof(Header));
+      return fnv1a(hash, payload, header.size);
+    }
+
+    void write_all(int fd, const char* data, size_t size, off_t offset, const std::string& name) {
+      while (size > 0) {
+        ssize_t n = ::pwrite(fd, data, size, offset);
+        if (n <= 0) {
+          throw std::runtime_error("WriteAheadLog: cannot write " + name);
+        }
+        data += n;
+        size -= n;
+        offset += n;
+      }
+    }
+
+    //side files are small, they are rewritten as a whole
+    void write_file(const std::string& name, const std::string& content) {
+      int fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd < 0) {
+        throw std::runtime_error("WriteAheadLog: cannot open " + name);
+      }
+      write_all(fd, content.data(), content.size(), 0, name);
+      sync_fd(fd);
+      ::close(fd);
+    }
+
+    //File payload: name length, name, content
+    std::string encode_file(const std::string& name, const std::string& content) {
+      std::uint64_t name_size = name.size();
+      std::string payload(reinterpret_cast<const char*>(&name_size), sizeof(name_size));
+      payload += name;
+      payload += content;
+      return payload;
+    }
+  }
+
+  WriteAheadLog& WriteAheadLog::instance() {
+    static WriteAheadLog log;
+    return log;
+  }
+
+  WriteAheadLog::WriteAheadLog() : last_commit_(std::chrono::steady_clock::now()) {
+    fd_ = ::open(file_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+      throw std::runtime_error("WriteAheadLog: cannot open " + file_path);
+    }
+    recover();
+    reset();
+  }
+
+  WriteAheadLog::~WriteAheadLog() {
+    //whatever is still open was never committed, recovery would drop it anyway
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  off_t WriteAheadLog::append(RecordType type, std::uint32_t slot, std::int64_t id, const char* data, size_t size) {
+    RecordHeader header{static_cast<std::uint32_t>(type), slot, id, size, 0};
+    header.checksum = checksum(header, data);
+    const char* raw = reinterpret_cast<const char*>(&header);
+    buffer_.append(raw, sizeof(RecordHeader));
+    off_t offset = log_size();
+    buffer_.append(data, size);
+    if (buffer_.size() >= WAL_BUFFER_BYTES) {
+      flush_buffer();
+    }
+    return offset;
+  }
+
+  void WriteAheadLog::flush_buffer() {
+    if (buffer_.empty()) {
+      return;
+    }
+    write_all(fd_, buffer_.data(), buffer_.size(), buffer_start_, file_path);
+    buffer_start_ += static_cast<off_t>(buffer_.size());
+    buffer_.clear();
+  }
+
+  void WriteAheadLog::recover() {
+    struct Pending {
+      RecordHeader header;
+      off_t offset;
+      std::string payload;//kept for Meta and File only
+    };
+    struct CommittedMeta {
+      bool present = false;
+      DiskMeta meta;
+    };
+    char magic[sizeof(LOG_MAGIC)] = {};
+    if (::pread(fd_, magic, sizeof(magic), 0) != static_cast<ssize_t>(sizeof(magic)) ||
+        std::memcmp(magic, LOG_MAGIC, sizeof(magic)) != 0) {
+      return;//empty, or never got past its header
+    }
+    off_t end = ::lseek(fd_, 0, SEEK_END);
+
+    sjtu::vector<std::string> names;
+    sjtu::vector<Pending> pending;
+    sjtu::vector<sjtu::map<page_id_t, off_t>> pages;//per slot: page id -> offset of the committed image
+    sjtu::vector<CommittedMeta> metas;
+    sjtu::map<std::string, std::string> files;
+
+    off_t pos = sizeof(LOG_MAGIC);
+    std::string payload;
+    while (true) {
+      RecordHeader header{};
+      if (::pread(fd_, &header, sizeof(header), pos) != static_cast<ssize_t>(sizeof(header))) {
+        break;
+      }
+      off_t offset = pos + static_cast<off_t>(sizeof(header));
+      if (header.size > static_cast<std::uint64_t>(end - offset)) {
+        break;//torn tail
+      }
+      payload.resize(header.size);
+      if (::pread(fd_, payload.data(), header.size, offset) != static_cast<ssize_t>(header.size) ||
+          checksum(header, payload.data()) != header.checksum) {
+        break;
+      }
+      pos = offset + static_cast<off_t>(header.size);
+
+      auto type = static_cast<RecordType>(header.type);
+      if (type == RecordType::Slot) {
+        if (header.slot >= names.size()) {
+          names.resize(header.slot + 1);
+        }
+        names[header.slot] = payload;
+      } else if (type == RecordType::Commit) {
+        for (auto& record: pending) {
+          std::uint32_t slot = record.header.slot;
+          switch (static_cast<RecordType>(record.header.type)) {
+            case RecordType::Page:
+              if (slot >= pages.size()) {
+                pages.resize(slot + 1);
+              }
+              pages[slot][record.header.id] = record.offset;
+              break;
+            case RecordType::Meta:
+              if (slot >= metas.size()) {
+                metas.resize(slot + 1);
+              }
+              metas[slot].present = true;
+              std::memcpy(&metas[slot].meta, record.payload.data(), sizeof(DiskMeta));
+              break;
+            case RecordType::File: {
+              std::uint64_t name_size;
+              std::memcpy(&name_size, record.payload.data(), sizeof(name_size));
+              files[record.payload.substr(sizeof(name_size), name_size)] =
+                  record.payload.substr(sizeof(name_size) + name_size);
+              break;
+            }
+            default:
+              break;
+          }
+        }
+        pending.clear();
+      } else {
+        Pending record{header, offset, {}};
+        if (type != RecordType::Page) {
+          record.payload = payload;
+        }
+        pending.push_back(std::move(record));
+      }
+    }
+
+    size_t slot_count = pages.size() > metas.size() ? pages.size() : metas.size();
+    char page[PAGESIZE];
+    for (size_t slot = 0; slot < slot_count; ++slot) {
+      bool has_pages = slot < pages.size() && !pages[slot].empty();
+      bool has_meta = slot < metas.size() && metas[slot].present;
+      if (!has_pages && !has_meta) {
+        continue;
+      }
+      if (slot >= names.size() || names[slot].empty()) {
+        throw std::runtime_error("WriteAheadLog: committed records of an unknown file");
+      }
+      const std::string& name = names[slot];
+      int fd = ::open(name.c_str(), O_RDWR | O_CREAT, 0644);
+      if (fd < 0) {
+        throw std::runtime_error("WriteAheadLog: cannot open " + name);
+      }
+      if (has_pages) {
+        for (auto it = pages[slot].begin(); it != pages[slot].end(); ++it) {
+          if (::pread(fd_, page, PAGESIZE, it->second) != PAGESIZE) {
+            throw std::runtime_error("WriteAheadLog: cannot read " + file_path);
+          }
+          write_all(fd, page, PAGESIZE, static_cast<off_t>(it->first) * PAGESIZE, name);
+        }
+      }
+      if (has_meta) {
+        write_all(fd, reinterpret_cast<const char*>(&metas[slot].meta), sizeof(DiskMeta), 0, name);
+      }
+      sync_fd(fd);
+      ::close(fd);
+    }
+    for (auto it = files.begin(); it != files.end(); ++it) {
+      write_file(it->first, it->second);
+    }
+  }
+
+  void WriteAheadLog::reset() {
+    buffer_.clear();
+    buffer_start_ = 0;
+    if (::ftruncate(fd_, 0) != 0) {
+      throw std::runtime_error("WriteAheadLog: cannot truncate " + file_path);
+    }
+    buffer_.append(LOG_MAGIC, sizeof(LOG_MAGIC));
+    for (size_t slot = 0; slot < disks_.size(); ++slot) {
+      if (disks_[slot] != nullptr) {
+        append(RecordType::Slot, slot, 0, slot_names_[slot].data(), slot_names_[slot].size());
+      }
+    }
+    flush_buffer();
+    sync_fd(fd_, true);
+  }
+
+  std::uint32_t WriteAheadLog::attach(LoggedDiskManager* disk, const std::string& file_name) {
+    std::lock_guard<std::mutex> guard(latch_);
+    auto slot = static_cast<std::uint32_t>(disks_.size());
+    disks_.push_back(disk);
+    slot_names_.push_back(file_name);
+    if (durability_logged()) {
+      append(RecordType::Slot, slot, 0, file_name.data(), file_name.size());
+    }
+    return slot;
+  }
+
+  void WriteAheadLog::detach(LoggedDiskManager* disk) {
+    //committed pages of this file would be lost with the next reset, write them home first
+    if (disk->HasLoggedPages()) {
+      checkpoint();
+    }
+    std::lock_guard<std::mutex> guard(latch_);
+    for (auto& attached: disks_) {
+      if (attached == disk) {
+        attached = nullptr;
+      }
+    }
+  }
+
+  void WriteAheadLog::attach_pool(BufferPoolManager* pool) {
+    std::lock_guard<std::mutex> guard(latch_);
+    pools_.push_back(pool);
+  }
+
+  void WriteAheadLog::detach_pool(BufferPoolManager* pool) {
+    std::lock_guard<std::mutex> guard(latch_);
+    for (size_t i = 0; i < pools_.size(); ++i) {
+      if (pools_[i] == pool) {
+        pools_.erase(i);
+        return;
+      }
+    }
+  }
+
+  void WriteAheadLog::register_file(const std::string& file_name, std::function<std::string()> dump,
+                                    std::function<bool()> changed) {
+    std::lock_guard<std::mutex> guard(latch_);
+    files_.push_back({file_name, std::move(dump), std::move(changed), std::nullopt});
+  }
+
+  void WriteAheadLog::unregister_file(const std::string& file_name) {
+    std::lock_guard<std::mutex> guard(latch_);
+    for (size_t i = 0; i < files_.size(); ++i) {
+      if (files_[i].name == file_name) {
+        //erase() memmoves, which a std::string cannot take; the order of side files does not matter
+        if (i + 1 != files_.size()) {
+          files_[i] = std::move(files_.back());
+        }
+        files_.pop_back();
+        return;
+      }
+    }
+  }
+
+  off_t WriteAheadLog::append_page(std::uint32_t slot, page_id_t page_id, const char* data) {
+    std::lock_guard<std::mutex> guard(latch_);
+    return append(RecordType::Page, slot, page_id, data, PAGESIZE);
+  }
+
+  void WriteAheadLog::read(off_t offset, char* data, size_t size) {
+    std::lock_guard<std::mutex> guard(latch_);
+    if (offset >= buffer_start_) {
+      std::memcpy(data, buffer_.data() + (offset - buffer_start_), size);
+      return;
+    }
+    if (::pread(fd_, data, size, offset) != static_cast<ssize_t>(size)) {
+      throw std::runtime_error("WriteAheadLog: cannot read " + file_path);
+    }
+  }
+
+  bool WriteAheadLog::end_command() {
+    if (!durability_logged()) {
+      return false;
+    }
+    ++pending_commands_;
+    if (durability() == Durability::Command || pending_commands_ >= WAL_GROUP_COMMANDS ||
+        std::chrono::steady_clock::now() - last_commit_ >= std::chrono::milliseconds(WAL_GROUP_MS)) {
+      commit();
+      return true;
+    }
+    return false;
+  }
+
+  bool WriteAheadLog::commit_idle() {
+    if (!durability_logged() || pending_commands_ == 0) {
+      return false;
+    }
+    commit();
+    return true;
+  }
+
+  void WriteAheadLog::commit() {
+    if (!durability_logged()) {
+      return;
+    }
+    commit_group();
+    if (log_size() > static_cast<off_t>(WAL_CHECKPOINT_BYTES)) {
+      checkpoint_committed();
+    }
+  }
+
+  void WriteAheadLog::checkpoint() {
+    if (durability_logged()) {
+      commit_group();
+    } else {
+      sjtu::vector<BufferPoolManager*> pools;
+      {
+        std::lock_guard<std::mutex> guard(latch_);
+        pools = pools_;
+        for (auto& file: files_) {
+          file.committed = file.dump();
+        }
+      }
+      for (auto* pool: pools) {//written in place
+        pool->FlushAllPages();
+      }
+    }
+    checkpoint_committed();
+  }
+
+  void WriteAheadLog::commit_group() {
+    sjtu::vector<BufferPoolManager*> pools;
+    {
+      std::lock_guard<std::mutex> guard(latch_);
+      pools = pools_;
+    }
+    for (auto* pool: pools) {//write_back lands in append_page
+      pool->FlushAllPages();
+    }
+
+    std::lock_guard<std::mutex> guard(latch_);
+    for (size_t slot = 0; slot < disks_.size(); ++slot) {
+      if (disks_[slot] != nullptr) {
+        const DiskMeta& meta = disks_[slot]->GetMeta();
+        append(RecordType::Meta, slot, 0, reinterpret_cast<const char*>(&meta), sizeof(DiskMeta));
+      }
+    }
+    for (auto& file: files_) {
+      if (file.committed && file.changed && !file.changed()) {
+        continue;
+      }
+      std::string content = file.dump();
+      if (!file.committed || content != *file.committed) {
+        std::string payload = encode_file(file.name, content);
+        append(RecordType::File, 0, 0, payload.data(), payload.size());
+        file.committed = std::move(content);
+      }
+    }
+    append(RecordType::Commit, 0, 0, nullptr, 0);
+    flush_buffer();
+    sync_fd(fd_, true);
+    pending_commands_ = 0;
+    last_commit_ = std::chrono::steady_clock::now();
+  }
+
+  void WriteAheadLog::checkpoint_committed() {
+    sjtu::vector<LoggedDiskManager*> disks;
+    {
+      std::lock_guard<std::mutex> guard(latch_);
+      disks = disks_;
+    }
+    for (auto* disk: disks) {//reads its pages back through read()
+      if (disk != nullptr) {
+        disk->Checkpoint();
+      }
+    }
+    std::lock_guard<std::mutex> guard(latch_);
+    for (const auto& file: files_) {
+      if (file.committed) {
+        write_file(file.name, *file.committed);
+      }
+    }
+    if (durability_logged()) {
+      reset();
+    }
+  }
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include "common.h"
+#include "durability.h"
+#include "vector.hpp"
+
+namespace RFlowey {
+  class BufferPoolManager;
+  class LoggedDiskManager;
+  struct DiskMeta;
+
+  /**
+   * Redo log shared by every LoggedDiskManager of the process.
+   * Between checkpoints the data files are never written: page images, file headers and the
+   * registered side files are appended here, and a COMMIT record makes everything before it one durable unit.
+   * Recovery replays up to the last intact COMMIT and drops the rest, so a crash loses at most the open group.
+   *
+   * Group commit: end_command() counts commands and commits once WAL_GROUP_COMMANDS have run
+   * or WAL_GROUP_MS have passed since the last commit, only a commit fsyncs the log.
+   * The deadline is only seen when a command ends, so the caller commits the open group with commit_idle()
+   * before it waits for input: a group stays open only while more commands are already queued.
+   * A commit that leaves the log longer than WAL_CHECKPOINT_BYTES is followed by a checkpoint:
+   * logged pages are copied into their files, everything is fsynced and the log starts over.
+   *
+   * Durability::Command commits after every command, Durability::None and Durability::Exit log nothing:
+   * the attached files are written in place and checkpoint() only flushes them, syncing for Exit.
+   * A log left by an earlier run is still recovered whatever the mode.
+   */
+  class WriteAheadLog {
+    enum class RecordType : std::uint32_t { Slot = 1, Page, Meta, File, Commit };
+
+    struct RecordHeader {
+      std::uint32_t type;
+      std::uint32_t slot;
+      std::int64_t id;
+      std::uint64_t size;//payload bytes following the header
+      std::uint64_t checksum;//over the header with checksum 0, then the payload
+    };
+
+    struct SideFile {
+      std::string name;
+      std::function<std::string()> dump;
+      std::function<bool()> changed;//optional, false lets a commit skip dump()
+      std::optional<std::string> committed;//content as of the last commit, unknown until the first one
+    };
+
+    inline static std::string file_path = "./persistent_std.wal";
+
+    std::mutex latch_;//guards the append buffer, the file and the attached lists
+    int fd_ = -1;
+    std::string buffer_;//records not handed to the kernel yet
+    off_t buffer_start_ = 0;//log offset of buffer_[0]
+
+    sjtu::vector<LoggedDiskManager*> disks_;//indexed by slot, nullptr once detached
+    sjtu::vector<std::string> slot_names_;
+    sjtu::vector<BufferPoolManager*> pools_;
+    sjtu::vector<SideFile> files_;
+
+    size_t pending_commands_ = 0;
+    std::chrono::steady_clock::time_point last_commit_;
+
+    WriteAheadLog();
+    ~WriteAheadLog();
+
+    off_t append(RecordType type, std::uint32_t slot, std::int64_t id, const char* data, size_t size);
+    void flush_buffer();
+    [[nodiscard]] off_t log_size() const { return buffer_start_ + static_cast<off_t>(buffer_.size()); }
+
+    /**
+     * @brief apply every committed record to the data files, before any of them is opened
+     */
+    void recover();
+    //empty the log, keeping the slot table of the files still attached
+    void reset();
+    //make the current state durable, without checkpointing
+    void commit_group();
+    //copy the committed state into the files and reset, the caller has just committed
+    void checkpoint_committed();
+
+  public:
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    /**
+     * @brief the log of this process, recovered on first use.
+     * @warning call it before any LoggedDiskManager or FiledConfig tracker opens its file
+     * @throw std::runtime_error if the log cannot be opened
+     */
+    static WriteAheadLog& instance();
+
+    /**
+     * @warning only has effect before the first instance()
+     */
+    static void set_file_path(const std::string& path) {
+      file_path = path;
+    }
+
+    /**
+     * @return slot of the file, its pages are logged under it
+     */
+    std::uint32_t attach(LoggedDiskManager* disk, const std::string& file_name);
+    void detach(LoggedDiskManager* disk);
+
+    /**
+     * @brief flushed into the log by every commit
+     */
+    void attach_pool(BufferPoolManager* pool);
+    void detach_pool(BufferPoolManager* pool);
+
+    /**
+     * @brief keep a file outside the trees under the log, dump() is called at each commit
+     * and the whole content is logged whenever it changed
+     * @param changed if given, asked first; false means nothing changed since the last call and dump() is skipped
+     */
+    void register_file(const std::string& file_name, std::function<std::string()> dump,
+                       std::function<bool()> changed = nullptr);
+    void unregister_file(const std::string& file_name);
+
+    /**
+     * @return log offset of the image, for read()
+     */
+    off_t append_page(std::uint32_t slot, page_id_t page_id, const char* data);
+    void read(off_t offset, char* data, size_t size);
+
+    /**
+     * @brief called after each command, commits when the group is full or old enough
+     * @return true if the commands so far are durable now, their output may be released
+     */
+    bool end_command();
+    /**
+     * @brief commit the open group if a command ran since the last commit, call it before blocking on input
+     * @return true if it committed, like end_command()
+     */
+    bool commit_idle();
+    void commit();
+    /**
+     * @brief commit, then bring every file up to date and empty the log.
+     * Without the log, flush every attached store and side file in place.
+     */
+    void checkpoint();
+  };
+}
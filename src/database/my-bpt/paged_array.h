@@ -0,0 +1,173 @@
+#pragma once
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "disk/IO_manager.h"
+#include "disk/IO_utils.h"
+#include "disk/tablespace.h"
+#include "common.h"
+#include "my_fileconfig.h"
+
+
+namespace RFlowey {
+
+  /**
+   * Append-only array of fixed-size records packed into consecutive pages.
+   * Record i lives at page first_page + i / PER_PAGE, so a lookup is one page access without any index.
+   * Records never span two pages and are never removed, except by clear().
+   *
+   * @tparam DiskManager IOManager backing the file, see BPT
+   */
+  template<typename T, typename DiskManager = LoggedDiskManager>
+  class PagedArray {
+    static_assert(std::is_base_of_v<IOManager, DiskManager>, "DiskManager must implement IOManager");
+    static_assert(PageAble<T>, "records are used in place inside the frame");
+
+  public:
+    static constexpr size_t PER_PAGE = PAGESIZE / sizeof(T);
+
+  private:
+    DiskManager disk_;
+    BufferPoolManager manager_;
+
+    //stamped in the file header and the config, a record size of 0 never matches
+    static constexpr long FORMAT = 0x50410000L | static_cast<long>(sizeof(T));
+
+    struct PagedArray_config {
+      long format;
+      page_id_t first_page;
+      size_t page_count;
+      size_t size;
+    };
+
+    //FiledConfig slot of an array on its own, the catalog holds it when the array belongs to a Tablespace
+    std::optional<RFlowey::FiledConfig::tracker_t_<PagedArray_config> > persis_config;
+    Tablespace *space_ = nullptr;
+    size_t catalog_slot_ = 0;
+    PagedArray_config cfg{};
+
+    //kept current on every change, a WAL commit snapshots the tracked values and the catalog page
+    void save_config() {
+      if (space_ != nullptr) {
+        space_->store_config(catalog_slot_, cfg);
+      } else {
+        persis_config->val = cfg;
+      }
+    }
+
+    pair<page_id_t, size_t> locate(size_t index) const {
+      if (index >= cfg.size) {
+        throw std::out_of_range("PagedArray: index out of range");
+      }
+      return {cfg.first_page + static_cast<page_id_t>(index / PER_PAGE), index % PER_PAGE * sizeof(T)};
+    }
+
+    //the disk manager hands out page ids in order as nothing is ever deleted here
+    void grow_to(size_t page_count) {
+      while (cfg.page_count < page_count) {
+        page_id_t id = manager_.AllocatePage();
+        if (cfg.page_count == 0) {
+          cfg.first_page = id;
+        } else if (id != cfg.first_page + static_cast<page_id_t>(cfg.page_count)) {
+          throw std::runtime_error("PagedArray: pages are not contiguous");
+        }
+        Page *page = manager_.NewPage(id);
+        manager_.UnpinPage(page, true);
+        ++cfg.page_count;
+      }
+      save_config();
+    }
+
+    //pages pass the file to this array for good, so their count bounds page_count
+    [[nodiscard]] bool config_valid() const {
+      return cfg.format == FORMAT && cfg.size <= cfg.page_count * PER_PAGE &&
+             cfg.page_count <= disk_.UsedPageCount() && (cfg.page_count == 0 || cfg.first_page > 0);
+    }
+
+    /**
+     * A config never written (format 0) or a file of another layout (an older build, another store) starts over.
+     * A file of ours with a config that does not describe it is an error.
+     */
+    void open_checked(const std::string &file_name) {
+      bool stamped = disk_.GetUserVersion() == FORMAT;
+      if (stamped && cfg.format == FORMAT) {
+        if (!config_valid()) {
+          throw std::runtime_error("PagedArray: the config of " + file_name + " does not match the file");
+        }
+        return;
+      }
+      if (stamped && cfg.format != 0) {
+        throw std::runtime_error("PagedArray: the config of " + file_name + " is not a PagedArray config");
+      }
+      if (!disk_.is_new) {
+        manager_.Clear();
+      }
+      disk_.SetUserVersion(FORMAT);
+      cfg = PagedArray_config{FORMAT, INVALID_PAGE_ID, 0, 0};
+      save_config();
+    }
+
+  public:
+    /**
+     * @throw std::runtime_error if the file is a PagedArray of this layout but the config does not describe it
+     */
+    explicit PagedArray(const std::string &file_name, size_t pool_size = BUFFER_POOL_SIZE)
+      : disk_(file_name), manager_(pool_size, &disk_) {
+      persis_config.emplace(PagedArray_config{0, INVALID_PAGE_ID, 0, 0});
+      cfg = persis_config->val;
+      open_checked(file_name);
+    }
+
+    /**
+     * @brief the records stay in file_name, their config goes to the catalog of space under the same name.
+     * A new catalog entry means the file belongs to no tree of this tablespace, it is emptied.
+     * @throw std::length_error if the name does not fit the catalog
+     * @throw std::runtime_error as for a PagedArray on its own
+     */
+    PagedArray(Tablespace &space, const std::string &file_name, size_t pool_size = BUFFER_POOL_SIZE)
+      : disk_(file_name), manager_(pool_size, &disk_), space_(&space) {
+      catalog_slot_ = space.open(file_name);
+      cfg = space.load_config<PagedArray_config>(catalog_slot_);
+      open_checked(file_name);
+    }
+
+    [[nodiscard]] size_t size() const {
+      return cfg.size;
+    }
+
+    /**
+     * @brief append n copies of init, a run of records may cross page boundaries
+     * @return index of the first new record
+     */
+    size_t extend(size_t n, const T &init) {
+      size_t first = cfg.size;
+      grow_to((first + n + PER_PAGE - 1) / PER_PAGE);
+      cfg.size = first + n;
+      save_config();
+      for (size_t i = first; i < first + n; ++i) {
+        *get_ref(i) = init;
+      }
+      return first;
+    }
+
+    [[nodiscard]] PageRef<T> get_ref(size_t index) {
+      auto pos = locate(index);
+      Page *page = manager_.FetchPage(pos.first);
+      return PageRef<T>{&manager_, page, View<T>(page->get_data() + pos.second)};
+    }
+
+    [[nodiscard]] ConstPageRef<T> get_const_ref(size_t index) {
+      auto pos = locate(index);
+      Page *page = manager_.FetchPage(pos.first);
+      return ConstPageRef<T>{&manager_, page, View<T>(static_cast<const char *>(page->get_data()) + pos.second)};
+    }
+
+    void clear() {
+      manager_.Clear();
+      cfg = PagedArray_config{FORMAT, INVALID_PAGE_ID, 0, 0};
+      save_config();
+    }
+  };
+}
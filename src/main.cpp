@@ -3,29 +3,74 @@
 #include "train.h"  // Added
 #include "order.h"  // Added
 
+#include <filesystem>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <optional> // Used by UserManager interface as provided
 
 bool TEST = false;
 
 
-int main() {
+int main(int argc, char *argv[]) {
+    // --durability=none|exit|command|group selects how every store survives a crash, group by default
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--durability=", 0) == 0) {
+            auto mode = RFlowey::parse_durability(arg.substr(13));
+            if (!mode) {
+                std::cerr << "Unknown durability mode: " << arg.substr(13) << "\n";
+                return 1;
+            }
+            RFlowey::set_durability(*mode);
+        }
+    }
     //freopen("my.out","w",stdout);
 
     std::ios_base::sync_with_stdio(false);
     std::cin.tie(nullptr);
     std::cout.tie(nullptr);
 
+    // Trees of builds before the tablespace each had a file of their own, they are not imported
+    if (!std::filesystem::exists("tablespace.dat")) {
+        for (const char *old_file : {"user_data.dat", "train_data.dat", "train_data_seg.dat", "train_data_station.dat",
+                                     "order_data_user_orders.dat", "order_data_waitlist.dat"}) {
+            if (std::filesystem::exists(old_file)) {
+                std::cerr << "Found " << old_file << " from an older build but no tablespace.dat, refusing to start "
+                          << "rather than ignoring it; move the old data files away to start empty\n";
+                return 1;
+            }
+        }
+    }
+
     CommandParser parser;
-    UserManager userManager;
-    TrainManager trainManager; // Added
-    OrderManager orderManager; // Added
+    // Replays the log before any manager opens its files
+    RFlowey::WriteAheadLog &wal = RFlowey::WriteAheadLog::instance();
+    RFlowey::Tablespace tablespace("tablespace.dat"); // Every tree of the managers, behind one shared pool
+    UserManager userManager(tablespace);
+    TrainManager trainManager(tablespace); // Added
+    OrderManager orderManager(tablespace); // Added
 
     trainManager.load_id_name_mapping(); // Load station name mappings at startup
 
     std::string line;
-    while (std::getline(std::cin, line)) {
+    // Output is held here until the commands that produced it are committed, a crash cannot show a lost result
+    std::ostringstream out;
+    auto release = [&out](bool flush) {
+        std::cout << out.str();
+        out.str("");
+        if (flush) {
+            std::cout.flush();
+        }
+    };
+    // With nothing left in the input, the open group is committed before blocking: the process may sit idle for long
+    auto next_line = [&wal, &release](std::string &line) {
+        if (std::cin.rdbuf()->in_avail() <= 0 && wal.commit_idle()) {
+            release(true);
+        }
+        return static_cast<bool>(std::getline(std::cin, line));
+    };
+    while (next_line(line)) {
         if (line.empty() && std::cin.eof()) {
             break;
         }
@@ -36,7 +81,7 @@ int main() {
             continue;
         }
 
-        std::cout << "[" << parser.timestamp << "] ";
+        out << "[" << parser.timestamp << "] ";
 
         if (parser.commandName == "add_user") {
             std::string cur_username_str = parser.getArg("c"); // May be empty if first user
@@ -57,24 +102,24 @@ int main() {
             // UserManager's addUser handles the logic of first user privilege being 10 and ignoring -g.
 
             int result = userManager.addUser(cur_username, new_username, password, name, mail_addr, privilege);
-            std::cout << result << "\n";
+            out << result << "\n";
 
         } else if (parser.commandName == "login") {
             Username_t username = parser.getArg("u");
             Password_t password = parser.getArg("p");
             int result = userManager.loginUser(username, password);
-            std::cout << result << "\n";
+            out << result << "\n";
 
         } else if (parser.commandName == "logout") {
             Username_t username = parser.getArg("u");
             int result = userManager.logoutUser(username);
-            std::cout << result << "\n";
+            out << result << "\n";
 
         } else if (parser.commandName == "query_profile") {
             Username_t cur_username = parser.getArg("c");
             Username_t target_username = parser.getArg("u");
             std::string result = userManager.queryProfile(cur_username, target_username);
-            std::cout << result << "\n"; // Expects single line or -1, main adds newline
+            out << result << "\n"; // Expects single line or -1, main adds newline
 
         } else if (parser.commandName == "modify_profile") {
             Username_t cur_username = parser.getArg("c");
@@ -97,7 +142,7 @@ int main() {
             std::string result = userManager.modifyProfile(cur_username, target_username,
                                                            new_password_opt, new_name_opt,
                                                            new_mail_addr_opt, new_privilege_opt);
-            std::cout << result << "\n"; // Expects single line or -1, main adds newline
+            out << result << "\n"; // Expects single line or -1, main adds newline
 
         } else if (parser.commandName == "add_train") {
             std::string train_id = parser.getArg("i");
@@ -111,23 +156,23 @@ int main() {
             std::string sale_date_str = parser.getArg("d");
             std::string type_str = parser.getArg("y");
             int result = trainManager.add_train(train_id, station_num_str, seat_num_str, stations_str, prices_str, start_time_str, travel_times_str, stopover_times_str, sale_date_str, type_str);
-            std::cout << result << "\n";
+            out << result << "\n";
 
         } else if (parser.commandName == "delete_train") {
             std::string train_id = parser.getArg("i");
             int result = trainManager.delete_train(train_id);
-            std::cout << result << "\n";
+            out << result << "\n";
 
         } else if (parser.commandName == "release_train") {
             std::string train_id = parser.getArg("i");
             int result = trainManager.release_train(train_id);
-            std::cout << result << "\n";
+            out << result << "\n";
 
         } else if (parser.commandName == "query_train") {
             std::string train_id = parser.getArg("i");
             std::string date_str = parser.getArg("d");
             std::string result_str = trainManager.query_train(train_id, date_str);
-            std::cout << result_str; // Expects multi-line with its own newlines
+            out << result_str; // Expects multi-line with its own newlines
 
         } else if (parser.commandName == "query_ticket") {
             std::string from_station = parser.getArg("s");
@@ -138,7 +183,7 @@ int main() {
                 sort_pref = parser.getArg("p");
             }
             std::string result_str = trainManager.query_ticket(from_station, to_station, date_str, sort_pref);
-            std::cout << result_str; // Expects multi-line with its own newlines
+            out << result_str; // Expects multi-line with its own newlines
 
         } else if (parser.commandName == "query_transfer") {
             std::string from_station = parser.getArg("s");
@@ -149,7 +194,22 @@ int main() {
                 sort_pref = parser.getArg("p");
             }
             std::string result_str = trainManager.query_transfer(from_station, to_station, date_str, sort_pref);
-            std::cout << result_str ; // Expects multi-line or "0\n", with its own newlines
+            out << result_str ; // Expects multi-line or "0\n", with its own newlines
+
+        } else if (parser.commandName == "query_route") {
+            std::string from_station = parser.getArg("s");
+            std::string to_station = parser.getArg("t");
+            std::string date_str = parser.getArg("d");
+            std::string sort_pref = "time";
+            if (parser.hasArg("p")) {
+                sort_pref = parser.getArg("p");
+            }
+            std::string max_transfers_str; // TrainManager falls back to its default
+            if (parser.hasArg("k")) {
+                max_transfers_str = parser.getArg("k");
+            }
+            std::string result_str = trainManager.query_route(from_station, to_station, date_str, sort_pref, max_transfers_str);
+            out << result_str;
 
         } else if (parser.commandName == "buy_ticket") {
             std::string username_str = parser.getArg("u");
@@ -164,20 +224,20 @@ int main() {
             }
 
             if (!userManager.isUserLoggedIn(username_str)) {
-                std::cout << -1 << "\n";
+                out << -1 << "\n";
             } else {
                 std::string result_str = trainManager.buy_ticket(orderManager, parser.timestamp, username_str, train_id_str, date_str, num_tickets_str, from_station_str, to_station_str, queue_pref_str);
-                std::cout << result_str << "\n"; // Expects single line (price, "queue", or -1), main adds newline
+                out << result_str << "\n"; // Expects single line (price, "queue", or -1), main adds newline
             }
 
         } else if (parser.commandName == "query_order") {
             std::string username_str = parser.getArg("u");
             if (!userManager.isUserLoggedIn(username_str)) {
-                std::cout << -1 << "\n";
+                out << -1 << "\n";
             } else {
                 UsernameKey user_key(username_str.c_str());
                 std::string result_str = orderManager.query_order(user_key);
-                std::cout << result_str; // Expects multi-line with its own newlines
+                out << result_str; // Expects multi-line with its own newlines
             }
 
         } else if (parser.commandName == "refund_ticket") {
@@ -187,28 +247,44 @@ int main() {
                 n_val = std::stoi(parser.getArg("n"));
             }
             if (!userManager.isUserLoggedIn(username_str)) {
-                std::cout << -1 << "\n";
+                out << -1 << "\n";
             } else {
                 UsernameKey user_key(username_str.c_str());
                 auto result = orderManager.refund_order_for_user(user_key,n_val,trainManager);
-                std::cout<<result<<'\n';
+                out<<result<<'\n';
             }
         } else if (parser.commandName == "clean") {
             userManager.cleanAllData();
             trainManager.clean_data(); // Added
             orderManager.clear_data(); // Added
-            std::cout << 0 << "\n";
+            out << 0 << "\n";
 
         } else if (parser.commandName == "exit") {
             userManager.handleSystemExit();
             trainManager.handle_exit(); // Persists id_to_name map
             // OrderManager data is persisted by BPTs automatically on destruction or flush.
-            std::cout << "bye\n";
+            out << "bye\n";
             break;
         } else {
              throw std::runtime_error("Unidentified command:"+parser.commandName);
         }
+        bool durable = wal.end_command();
+        if (durable || !RFlowey::durability_logged()) {
+            release(durable);
+        }
     }
 
+    wal.checkpoint(); // Leaves nothing to replay, the destructors below only rewrite the same values
+    release(true);
+    std::cerr << "durability " << RFlowey::durability_name(RFlowey::durability()) << ": "
+              << RFlowey::fsync_count() << " fsyncs\n";
+    auto report_filter = [](const char *name, const BloomStats &stats) {
+        std::cerr << "bloom filter " << name << ": " << stats.queries << " queries, " << stats.negatives
+                  << " negatives, " << stats.false_positives << " false positives, false positive rate "
+                  << stats.false_positive_rate() << "\n";
+    };
+    report_filter("users", userManager.filterStats());
+    report_filter("trains", trainManager.filter_stats());
+    report_filter("waitlist", orderManager.filter_stats());
     return 0;
 }
\ No newline at end of file
@@ -3,26 +3,51 @@
 void OrderManager::record_order(const UsernameKey &user_key, const Order &order) {
   user_orders_.insert({user_key.hash(), order.command_ts}, order);
   if (order.status == OrderStatus::PENDING) {
-    waitlist_.insert({order.train_hash, order.original_train_date},
-                     WaitlistEntry{
-                       order.command_ts, user_key.hash(),
-                       order.from_station_idx, order.to_station_idx,
-                       order.num_tickets
-                     });
+    WaitlistKey key{order.train_hash, order.original_train_date};
+    WaitlistEntry entry{
+      order.command_ts, user_key.hash(),
+      order.from_station_idx, order.to_station_idx,
+      order.num_tickets
+    };
+    waitlist_.insert(key, entry);
+    hash_t key_hash = waitlist_.hash_func(key);
+    if (const unsigned *mask = waiting_mask_.get(key_hash)) {
+      waiting_mask_.put(key_hash, *mask | entry.segments());
+    }
   }
 }
 
-sjtu::vector<WaitlistEntry> OrderManager::get_wait_list(const WaitlistKey &key) {
-  return waitlist_.find(key);
+sjtu::vector<WaitlistEntry> OrderManager::get_wait_list(const WaitlistKey &key, unsigned freed_segments) {
+  hash_t key_hash = waitlist_.hash_func(key);
+  const unsigned *mask = waiting_mask_.get(key_hash);
+  if (mask && (*mask & freed_segments) == 0) {
+    return {};
+  }
+  if (!waitlist_.might_contain_hash(key_hash)) {
+    waiting_mask_.put(key_hash, 0);
+    return {};
+  }
+  //entries of a key are stored in timestamp order
+  sjtu::vector<WaitlistEntry> overlapping;
+  unsigned waiting = 0;
+  for (auto it = waitlist_.seek_by_hash(key_hash); it.valid() && it.key().first == key_hash; it.next()) {
+    const WaitlistEntry &entry = it.key().second;
+    waiting |= entry.segments();
+    if (entry.segments() & freed_segments) {
+      overlapping.push_back(entry);
+    }
+  }
+  waiting_mask_.put(key_hash, waiting);
+  return overlapping;
 }
 
 std::string OrderManager::query_order(const UsernameKey &user_key) {
   std::ostringstream oss;
-  auto result = user_orders_.find_range({user_key.hash(), 0}, {user_key.hash(), std::numeric_limits<int>::max()});
-  oss << result.size() << '\n';
-  while (!result.empty()){
-    oss << result.back().second.format_for_query() << '\n';
-    result.pop_back();
+  OrderKey lo{user_key.hash(), 0}, hi{user_key.hash(), std::numeric_limits<int>::max()};
+  oss << user_orders_.range_aggregate(lo, hi) << '\n';
+  //newest first, straight from the leaves
+  for (auto it = user_orders_.seek_for_prev(hi); it.valid() && it.key().first == user_key.hash(); it.prev()) {
+    oss << it.value().format_for_query() << '\n';
   }
   return oss.str();
 }
@@ -38,17 +63,20 @@ void OrderManager::remove_from_waitlist(const WaitlistKey& wk, const WaitlistEnt
 }
 
 std::optional<OrderManager::RefundableOrderInfo> OrderManager::get_nth_refundable_order(const UsernameKey& user_key, int n) {
-    auto user_order_pairs = user_orders_.find_range({user_key.hash(), std::numeric_limits<int>::min()},
-                                                   {user_key.hash(), std::numeric_limits<int>::max()});
-
-    if (n <= 0 || static_cast<size_t>(n) > user_order_pairs.size()) {
+    if (n <= 0) {
         return std::nullopt;
     }
-
-    int target_idx_in_ascending_list = user_order_pairs.size() - n;
-
-    const auto& pair_to_refund = user_order_pairs[target_idx_in_ascending_list];
-    return RefundableOrderInfo{pair_to_refund.second, pair_to_refund.first};
+    // The n-th latest order is picked by position, without walking the orders in between
+    OrderKey lo{user_key.hash(), 0}, hi{user_key.hash(), std::numeric_limits<int>::max()};
+    size_t order_count = user_orders_.range_aggregate(lo, hi);
+    if (static_cast<size_t>(n) > order_count) {
+        return std::nullopt;
+    }
+    auto entry = user_orders_.select(lo, hi, order_count - n);
+    if (!entry) {
+        return std::nullopt;
+    }
+    return RefundableOrderInfo{entry->second, entry->first};
 }
 
 // New method implementation
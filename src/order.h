@@ -76,6 +76,13 @@ struct WaitlistKeyHasher {
   }
 };
 
+//bit i is set for every segment i in [start_idx, end_idx), a train has at most 24 segments
+inline unsigned segment_mask(int start_idx, int end_idx) {
+  return ((1u << end_idx) - 1) & ~((1u << start_idx) - 1);
+}
+
+constexpr size_t WAITING_MASK_CACHE_SIZE = 4096;
+
 struct WaitlistEntry {
     int command_ts;
     hash_t user_hash;
@@ -83,6 +90,10 @@ struct WaitlistEntry {
     int end_idx;
     int num_tickets_needed;
 
+    unsigned segments() const {
+        return segment_mask(start_idx, end_idx);
+    }
+
     static bool sortByTimestamp(const WaitlistEntry& a, const WaitlistEntry& b) {
         return a.command_ts < b.command_ts;
     }
@@ -98,18 +109,25 @@ struct WaitlistEntry {
 using OrderKey = RFlowey::pair<hash_t,int>;
 
 class OrderManager {
-  SingleMap<OrderKey, Order> user_orders_;
+  SingleMap<OrderKey, Order, RFlowey::LoggedDiskManager, RFlowey::CountAugment> user_orders_;//counted for refund_ticket -n
   OrderedHashMap<WaitlistKey, WaitlistEntry,WaitlistKeyHasher> waitlist_;
+  //union of the segments still waited for, per waitlist hash; derived from waitlist_, so it is only a cache.
+  //Entries leaving the waitlist keep it a superset until the next get_wait_list scan.
+  RFlowey::LRUCache<hash_t, unsigned> waiting_mask_{WAITING_MASK_CACHE_SIZE};
 
 public:
   constexpr static std::string db_path_prefix = "order_data";
 
-  OrderManager() : user_orders_(db_path_prefix + "_user_orders.dat"),
-                   waitlist_(db_path_prefix + "_waitlist.dat") {
+  explicit OrderManager(RFlowey::Tablespace &space) : user_orders_(space, db_path_prefix + "_user_orders"),
+                                                       waitlist_(space, db_path_prefix + "_waitlist") {
   }
 
   void record_order(const UsernameKey& user_key,const Order& order);
-  sjtu::vector<WaitlistEntry> get_wait_list(const WaitlistKey& key);
+  /**
+   * @brief pending orders of key whose segments overlap freed_segments, oldest first.
+   * Does not touch the waitlist file when the cached mask shows no pending order wants those segments.
+   */
+  sjtu::vector<WaitlistEntry> get_wait_list(const WaitlistKey& key, unsigned freed_segments);
   std::string query_order(const UsernameKey &user_key);
 
   bool update_order_status(const OrderKey &key, OrderStatus new_status);
@@ -128,5 +146,10 @@ public:
   void clear_data() {
     user_orders_.clear();
     waitlist_.clear();
+    waiting_mask_.clear();
+  }
+
+  [[nodiscard]] const BloomStats &filter_stats() const {
+    return waitlist_.filter.stats();
   }
 };
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "train.h"
+
+namespace {
+  //earliest day start at or after minutes, also for minutes before the epoch
+  Time_t day_at_or_after(Time_t minutes) {
+    if (minutes <= 0) {
+      return -(-minutes / TimeUtil::MINUTES_IN_DAY) * TimeUtil::MINUTES_IN_DAY;
+    }
+    return (minutes + TimeUtil::MINUTES_IN_DAY - 1) / TimeUtil::MINUTES_IN_DAY * TimeUtil::MINUTES_IN_DAY;
+  }
+
+  //a trip of one route within a round: the train boarded on `date`, with price_sum of the boarding stop taken off
+  struct RouteLabel {
+    Time_t date;
+    int base_price;
+    int parent;
+    Station_idx_t board;
+  };
+}
+
+void RoutePlanner::add_train(const TrainData &train) {
+  int index = static_cast<int>(trains_.size());
+  trains_.push_back(train);
+  for (int i = 0; i < train.station_num; ++i) {
+    if (train.stations[i] >= static_cast<int>(stops_at_.size())) {
+      stops_at_.resize(train.stations[i] + 1);
+    }
+    stops_at_[train.stations[i]].push_back({index, static_cast<Station_idx_t>(i)});
+  }
+}
+
+void RoutePlanner::collect_legs(const sjtu::vector<Label> &labels, const Label &label,
+                                sjtu::vector<const Label *> &legs) const {
+  legs.clear();
+  for (const Label *leg = &label; leg->parent != -1; leg = &labels[leg->parent]) {
+    legs.push_back(leg);
+  }
+}
+
+bool RoutePlanner::precedes(const sjtu::vector<Label> &labels, const Label &a, const Label &b) const {
+  sjtu::vector<const Label *> legs_a;
+  sjtu::vector<const Label *> legs_b;
+  collect_legs(labels, a, legs_a);
+  collect_legs(labels, b, legs_b);
+  if (legs_a.size() != legs_b.size()) {
+    return legs_a.size() < legs_b.size();
+  }
+  for (size_t i = legs_a.size(); i > 0; --i) {
+    const Label &x = *legs_a[i - 1];
+    const Label &y = *legs_b[i - 1];
+    const TrainID_t &id_x = trains_[x.train].train_id;
+    const TrainID_t &id_y = trains_[y.train].train_id;
+    if (id_x != id_y) {
+      return id_x < id_y;
+    }
+    if (x.date != y.date) {
+      return x.date < y.date;
+    }
+    if (x.board != y.board) {
+      return x.board < y.board;
+    }
+    if (x.alight != y.alight) {
+      return x.alight < y.alight;
+    }
+  }
+  return false;
+}
+
+bool RoutePlanner::try_add(sjtu::vector<Label> &labels, sjtu::vector<int> &bag_head, const Label &label,
+                           int target) const {
+  //nothing found later can beat or tie what already reaches the target, every train adds travel time
+  if (label.station != target) {
+    for (int i = bag_head[target]; i != -1; i = labels[i].next_in_bag) {
+      if (labels[i].arrive <= label.arrive && labels[i].price <= label.price) {
+        return false;
+      }
+    }
+  }
+  int prev = -1;//kept as an index, labels may move on push_back
+  for (int i = bag_head[label.station]; i != -1;) {
+    Label &other = labels[i];
+    int next = other.next_in_bag;
+    bool other_wins = other.arrive <= label.arrive && other.price <= label.price;
+    bool label_wins = label.arrive <= other.arrive && label.price <= other.price;
+    if (other_wins && label_wins) {
+      (precedes(labels, label, other) ? other_wins : label_wins) = false;
+    }
+    if (other_wins) {
+      return false;
+    }
+    if (label_wins) {
+      other.alive = false;
+      (prev == -1 ? bag_head[label.station] : labels[prev].next_in_bag) = next;
+    } else {
+      prev = i;
+    }
+    i = next;
+  }
+  labels.push_back(label);
+  labels.back().next_in_bag = bag_head[label.station];
+  labels.back().alive = true;
+  bag_head[label.station] = static_cast<int>(labels.size()) - 1;
+  return true;
+}
+
+sjtu::vector<RoutePlanner::Leg> RoutePlanner::plan(int from, int to, TimeUtil::DateTime depart_date,
+                                                   int max_transfers, bool by_cost) const {
+  int station_count = static_cast<int>(stops_at_.size());
+  if (from == to || from >= station_count || to >= station_count) {
+    return {};
+  }
+  Time_t depart = depart_date.getRawMinutes();
+
+  sjtu::vector<Label> labels;
+  sjtu::vector<int> bag_head;
+  sjtu::vector<int> marked_head;//labels added in the previous round, per station
+  sjtu::vector<int> marked_stations;
+  sjtu::vector<int> first_stop;//earliest marked stop of each train in this round, -1 if none
+  sjtu::vector<int> scanned_trains;
+  bag_head.resize(station_count, -1);
+  marked_head.resize(station_count, -1);
+  first_stop.resize(trains_.size(), -1);
+
+  labels.push_back({depart, 0, from, -1, -1, 0, 0, 0, -1, -1, true});
+  bag_head[from] = 0;
+  marked_head[from] = 0;
+  marked_stations.push_back(from);
+
+  for (int round = 0; round <= max_transfers && !marked_stations.empty(); ++round) {
+    scanned_trains.clear();
+    for (int station: marked_stations) {
+      for (const auto &stop: stops_at_[station]) {
+        if (first_stop[stop.first] == -1) {
+          scanned_trains.push_back(stop.first);
+          first_stop[stop.first] = stop.second;
+        } else if (stop.second < first_stop[stop.first]) {
+          first_stop[stop.first] = stop.second;
+        }
+      }
+    }
+    size_t round_begin = labels.size();
+    sjtu::vector<RouteLabel> route_bag;
+    for (int t: scanned_trains) {
+      const TrainData &train = trains_[t];
+      Time_t sale_start = train.sale_start.getRawMinutes();
+      Time_t sale_end = train.sale_end.getRawMinutes();
+      route_bag.clear();
+      for (int j = first_stop[t]; j < train.station_num; ++j) {
+        int station = train.stations[j];
+        for (const auto &trip: route_bag) {
+          Label label{
+            trip.date + train.arrive_times[j], trip.base_price + train.price_sum[j], station,
+            trip.parent, t, trip.board, static_cast<Station_idx_t>(j), trip.date, -1, -1, true
+          };
+          try_add(labels, bag_head, label, to);
+        }
+        if (j == train.station_num - 1) {
+          break;
+        }
+        for (int i = marked_head[station]; i != -1; i = labels[i].next_marked) {
+          const Label &from_label = labels[i];
+          if (from_label.train == t) {
+            continue;
+          }
+          Time_t date = day_at_or_after(from_label.arrive - train.leave_times[j]);
+          if (from_label.parent == -1) {
+            //the first train has to leave on the requested date
+            if (date < sale_start || date > sale_end) {
+              continue;
+            }
+          } else {
+            date = std::max(date, sale_start);
+            if (date > sale_end) {
+              continue;
+            }
+          }
+          RouteLabel trip{date, from_label.price - train.price_sum[j], i, static_cast<Station_idx_t>(j)};
+          bool dominated = false;
+          for (size_t k = 0; k < route_bag.size();) {
+            bool kept_wins = route_bag[k].date <= trip.date && route_bag[k].base_price <= trip.base_price;
+            bool trip_wins = trip.date <= route_bag[k].date && trip.base_price <= route_bag[k].base_price;
+            if (kept_wins && trip_wins) {//same trip of this train, the itinerary before it decides
+              const Label &kept_parent = labels[route_bag[k].parent];
+              bool trip_first = precedes(labels, labels[trip.parent], kept_parent) ||
+                                (!precedes(labels, kept_parent, labels[trip.parent]) && trip.board < route_bag[k].board);
+              (trip_first ? kept_wins : trip_wins) = false;
+            }
+            if (kept_wins) {
+              dominated = true;
+              break;
+            }
+            if (trip_wins) {
+              route_bag.erase(k);
+            } else {
+              ++k;
+            }
+          }
+          if (!dominated) {
+            route_bag.push_back(trip);
+          }
+        }
+      }
+    }
+
+    for (int station: marked_stations) {
+      marked_head[station] = -1;
+    }
+    marked_stations.clear();
+    for (int t: scanned_trains) {
+      first_stop[t] = -1;
+    }
+    for (size_t i = round_begin; i < labels.size(); ++i) {
+      if (!labels[i].alive) {
+        continue;
+      }
+      int station = labels[i].station;
+      if (marked_head[station] == -1) {
+        marked_stations.push_back(station);
+      }
+      labels[i].next_marked = marked_head[station];
+      marked_head[station] = static_cast<int>(i);
+    }
+  }
+
+  //bag labels are pairwise non-dominated, so the first key alone decides
+  int best = -1;
+  for (int i = bag_head[to]; i != -1; i = labels[i].next_in_bag) {
+    if (best == -1) {
+      best = i;
+      continue;
+    }
+    const Label &a = labels[i];
+    const Label &b = labels[best];
+    if (by_cost ? a.price < b.price : a.arrive < b.arrive) {
+      best = i;
+    }
+  }
+
+  sjtu::vector<Leg> reversed;
+  for (int i = best; i != -1 && labels[i].parent != -1; i = labels[i].parent) {
+    const Label &label = labels[i];
+    reversed.push_back({
+      static_cast<size_t>(label.train), label.board, label.alight, TimeUtil::DateTime(label.date)
+    });
+  }
+  sjtu::vector<Leg> legs;
+  for (size_t i = reversed.size(); i > 0; --i) {
+    legs.push_back(reversed[i - 1]);
+  }
+  return legs;
+}
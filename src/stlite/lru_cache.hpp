@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+
+#include "map.hpp"
+
+namespace RFlowey {
+  /**
+   * @brief Fixed-capacity cache of decoded values, the least recently used entry is evicted when full.
+   * Entries live in one array allocated up front, so the memory budget is capacity * sizeof(Value).
+   * get() counts hits and misses.
+   */
+  template<typename Key, typename Value>
+  class LRUCache {
+    struct Entry {
+      Key key;
+      Value value;
+      size_t prev;
+      size_t next;
+    };
+
+    size_t capacity_;
+    Entry *entries_;//entries_[capacity_] is the sentinel of the recency list, most recent first
+    size_t *free_slots_;
+    size_t free_size_ = 0;
+    sjtu::map<Key, size_t> index_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+
+    void unlink(size_t slot) {
+      entries_[entries_[slot].prev].next = entries_[slot].next;
+      entries_[entries_[slot].next].prev = entries_[slot].prev;
+    }
+
+    void push_front(size_t slot) {
+      entries_[slot].prev = capacity_;
+      entries_[slot].next = entries_[capacity_].next;
+      entries_[entries_[capacity_].next].prev = slot;
+      entries_[capacity_].next = slot;
+    }
+
+    void reset_slots() {
+      entries_[capacity_].prev = entries_[capacity_].next = capacity_;
+      free_size_ = 0;
+      for (size_t i = capacity_; i > 0; --i) {
+        free_slots_[free_size_++] = i - 1;
+      }
+    }
+
+  public:
+    explicit LRUCache(size_t capacity)
+      : capacity_(capacity), entries_(new Entry[capacity + 1]), free_slots_(new size_t[capacity]) {
+      reset_slots();
+    }
+
+    ~LRUCache() {
+      delete[] entries_;
+      delete[] free_slots_;
+    }
+
+    LRUCache(const LRUCache &) = delete;
+    LRUCache &operator=(const LRUCache &) = delete;
+
+    /**
+     * @return the cached value, valid until the next put/erase/clear; nullptr on a miss
+     */
+    const Value *get(const Key &key) {
+      auto it = index_.find(key);
+      if (it == index_.end()) {
+        ++misses_;
+        return nullptr;
+      }
+      ++hits_;
+      size_t slot = it->second;
+      unlink(slot);
+      push_front(slot);
+      return &entries_[slot].value;
+    }
+
+    void put(const Key &key, const Value &value) {
+      auto it = index_.find(key);
+      size_t slot;
+      if (it != index_.end()) {
+        slot = it->second;
+        unlink(slot);
+      } else {
+        if (free_size_ == 0) {
+          size_t victim = entries_[capacity_].prev;
+          unlink(victim);
+          index_.erase(index_.find(entries_[victim].key));
+          free_slots_[free_size_++] = victim;
+        }
+        slot = free_slots_[--free_size_];
+        entries_[slot].key = key;
+        index_.insert({key, slot});
+      }
+      entries_[slot].value = value;
+      push_front(slot);
+    }
+
+    void erase(const Key &key) {
+      auto it = index_.find(key);
+      if (it == index_.end()) {
+        return;
+      }
+      size_t slot = it->second;
+      unlink(slot);
+      index_.erase(it);
+      free_slots_[free_size_++] = slot;
+    }
+
+    void clear() {
+      index_.clear();
+      reset_slots();
+    }
+
+    [[nodiscard]] size_t size() const {
+      return index_.size();
+    }
+    [[nodiscard]] size_t hits() const {
+      return hits_;
+    }
+    [[nodiscard]] size_t misses() const {
+      return misses_;
+    }
+  };
+}
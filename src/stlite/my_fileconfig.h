@@ -6,6 +6,8 @@
 #include <stdexcept>
 #include <iostream>
 #include <utility>
+#include <cstring>
+#include "vector.hpp"
 
 namespace RFlowey {
 
@@ -34,6 +36,15 @@ namespace RFlowey {
     bool write_only; // True if the file was empty before any writes by this instance
     pos_t_ global_cur = 0; // Current global byte offset in the file
 
+    // Live trackers and the file content as loaded, together they make up image()
+    struct Tracked {
+      std::streamoff offset;
+      const void *val;
+      size_t size;
+    };
+    sjtu::vector<Tracked> tracked;
+    std::string loaded;
+
     FiledConfig() {
       std::filesystem::path p(file_path);
       if (p.has_parent_path()) {
@@ -90,6 +101,10 @@ namespace RFlowey {
         throw std::runtime_error(std::string("FiledConfig: Failed to resize file: ") + file_path + " (" + e.what() + ")");
       }
       
+      loaded.resize(std::filesystem::file_size(file_path));
+      fconfig.seekg(0, std::ios::beg);
+      fconfig.read(loaded.data(), static_cast<std::streamsize>(loaded.size()));
+      fconfig.clear();
       fconfig.seekg(0, std::ios::beg);
       fconfig.seekp(0, std::ios::beg);
 
@@ -149,11 +164,13 @@ namespace RFlowey {
           }
         }
         // If !attempt_load, 'val' remains 'default_value' and will be written on destruction.
+        singleton.tracked.push_back({static_cast<std::streamoff>(cur_offset), &val, sizeof(val_t_)});
       }
 
       ~RAII_Tracker() {
         try {
           auto &singleton = FiledConfig::get_instance();
+          singleton.retire(static_cast<std::streamoff>(cur_offset), &val, sizeof(val_t_));
           if (singleton.fconfig.is_open()) {
             singleton.fconfig.clear(); 
             singleton.fconfig.seekp(cur_offset);
@@ -180,10 +197,44 @@ namespace RFlowey {
       RAII_Tracker &operator=(RAII_Tracker &&) = delete;
     };
 
+    // keep the last value of a tracker going away in the image
+    void retire(std::streamoff offset, const void *val, size_t size) {
+      if (loaded.size() < static_cast<size_t>(offset) + size) {
+        loaded.resize(static_cast<size_t>(offset) + size);
+      }
+      std::memcpy(loaded.data() + offset, val, size);
+      for (size_t i = 0; i < tracked.size(); ++i) {
+        if (tracked[i].val == val) {
+          tracked.erase(i);
+          break;
+        }
+      }
+    }
+
   public:
     template <typename val_t_> 
     using tracker_t_ = RAII_Tracker<val_t_>;
 
+    static const std::string &get_file_path() {
+        return file_path;
+    }
+
+    /**
+     * @brief Whole file content as it would be after every live tracker wrote its current value.
+     * Used to log the config with the trees instead of relying on the destructors.
+     */
+    static std::string image() {
+      auto &singleton = get_instance();
+      std::string bytes = singleton.loaded;
+      for (const auto &t : singleton.tracked) {
+        if (bytes.size() < static_cast<size_t>(t.offset) + t.size) {
+          bytes.resize(static_cast<size_t>(t.offset) + t.size);
+        }
+        std::memcpy(bytes.data() + t.offset, t.val, t.size);
+      }
+      return bytes;
+    }
+
     /**
      * @brief Sets the file path for the configuration.
      * @warning This should be called BEFORE the first call to track() or any operation
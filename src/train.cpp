@@ -1,15 +1,21 @@
 #include "train.h"
 #include "order.h"
 
-TrainManager::TrainManager(): train_data_map_(db_path_prefix + ".dat"), seg_to_train_(db_path_prefix + "_seg.dat"),
-                              daily_seat(db_path_prefix + "_seat.dat") {
+TrainManager::TrainManager(RFlowey::Tablespace &space): train_data_map_(space, db_path_prefix),
+                                                       station_to_train_(space, db_path_prefix + "_station"),
+                                                       daily_seat(space, db_path_prefix + "_seat.dat") {
+  RFlowey::WriteAheadLog::instance().register_file(db_path_prefix + "_station_id_name.dat", dump_id_name_mapping);
+}
+
+TrainManager::~TrainManager() {
+  RFlowey::WriteAheadLog::instance().unregister_file(db_path_prefix + "_station_id_name.dat");
 }
 int TrainManager::add_train(const std::string &train_id_str, const std::string &station_num_str,
                             const std::string &seat_num_str, const std::string &stations_str,
                             const std::string &prices_str, const std::string &start_time_str,
                             const std::string &travel_times_str, const std::string &stopover_times_str,
                             const std::string &sale_date_str, const std::string &type_str) {
-  if (train_data_map_.find(train_id_str)) {
+  if (find_train(TrainID_t(train_id_str.c_str()))) {
     return -1;
   };
 
@@ -22,7 +28,7 @@ int TrainManager::add_train(const std::string &train_id_str, const std::string &
 }
 
 int TrainManager::delete_train(const std::string &train_id_str) {
-  auto result = train_data_map_.find(train_id_str);
+  auto result = find_train(TrainID_t(train_id_str.c_str()));
   if (!result) {
     return -1;
   }
@@ -31,11 +37,12 @@ int TrainManager::delete_train(const std::string &train_id_str) {
     return -1;
   }
   train_data_map_.erase(train.train_id);
+  train_cache_.erase(train.train_hash);
   return 0;
 }
 
 int TrainManager::release_train(const std::string &train_id_str) {
-  auto result = train_data_map_.find(train_id_str);
+  auto result = find_train(TrainID_t(train_id_str.c_str()));
   if (!result) {
     return -1;
   }
@@ -44,32 +51,46 @@ int TrainManager::release_train(const std::string &train_id_str) {
     return -1;
   }
 
+  sjtu::vector<RFlowey::pair<int, StationStop> > stops;
   for (int i = 0; i < train.station_num; ++i) {
-    for (int j = i + 1; j < train.station_num; ++j) {
-      seg_to_train_.insert({train.stations[i], train.stations[j]},
-                           {train.train_hash, {static_cast<Station_idx_t>(i), static_cast<Station_idx_t>(j)}});
-    }
+    stops.push_back({train.stations[i], StationStop(train, static_cast<Station_idx_t>(i))});
+  }
+  station_to_train_.bulk_insert(stops);
+
+  DailySeat full_seat{};
+  for (int i = 0; i + 1 < train.station_num; ++i) {
+    full_seat.seat[i] = static_cast<int>(train.seat_num);
+  }
+  size_t sale_days = (train.sale_end - train.sale_start) / TimeUtil::MINUTES_IN_DAY + 1;
+  size_t seat_base = daily_seat.extend(sale_days, full_seat);
+
+  train.release = true;
+  train.seat_base = seat_base;
+  train_data_map_.modify_by_hash(train.train_hash, train);
+  train_cache_.put(train.train_hash, train);
+  if (released_loaded_) {
+    route_planner_.add_train(train);
+    station_reach_.add_train(train);
   }
-  train_data_map_.modify_by_hash(train.train_hash, [&](TrainData& train_data) {
-    train_data.release = true;
-  });
   return 0;
 }
 
+std::optional<TrainData> TrainManager::find_train(hash_t train_hash) {
+  if (const TrainData *cached = train_cache_.get(train_hash)) {
+    return *cached;
+  }
+  auto train_data_opt = train_data_map_.find_by_hash(train_hash);
+  if (train_data_opt) {
+    train_cache_.put(train_hash, train_data_opt.value());
+  }
+  return train_data_opt;
+}
+
 int TrainManager::query_seat(const TrainData &train, Segment_t seg, TimeUtil::DateTime date) {
-  auto from_idx = seg.second.first;
-  auto to_idx = seg.second.second;
+  auto record = daily_seat.get_const_ref(seat_index(train, date));
   int min_seat = train.seat_num;
-  auto start_key = RFlowey::pair<TimeUtil::DateTime, RFlowey::pair<hash_t, Station_idx_t> >{
-    date, {train.train_hash, from_idx}
-  };
-  auto end_key = RFlowey::pair<TimeUtil::DateTime, RFlowey::pair<hash_t, Station_idx_t> >{
-    date, {train.train_hash, static_cast<Station_idx_t>(to_idx - 1)}
-  };
-
-  auto results = daily_seat.find_range(start_key, end_key);
-  for (const auto &p: results) {
-    min_seat = std::min(min_seat, p.second);
+  for (Station_idx_t i = seg.second.first; i < seg.second.second; ++i) {
+    min_seat = std::min(min_seat, record->seat[i]);
   }
   return min_seat;
 }
@@ -77,34 +98,10 @@ int TrainManager::query_seat(const TrainData &train, Segment_t seg, TimeUtil::Da
 bool TrainManager::reduce_seat(const TrainData &train,
                                Segment_t seg, const TimeUtil::DateTime &date,
                                int num_tickets) {
-  auto from_idx = seg.second.first;
-  auto to_idx = seg.second.second;
-  auto key_start = RFlowey::pair<TimeUtil::DateTime, RFlowey::pair<hash_t, Station_idx_t> >{
-    date, {train.train_hash, from_idx}
-  };
-  auto key_end = RFlowey::pair<TimeUtil::DateTime, RFlowey::pair<hash_t, Station_idx_t> >{
-    date, {train.train_hash, static_cast<Station_idx_t>(to_idx - 1)}
-  };
-
-  auto existing_segments = daily_seat.find_range(key_start, key_end);
-
-  size_t existing_ptr = 0;
-  for (Station_idx_t current_s_idx = from_idx; current_s_idx < to_idx; ++current_s_idx) {
-    if (existing_ptr < existing_segments.size() &&
-        existing_segments[existing_ptr].first.second.second == current_s_idx) {
-      existing_ptr++;
-    } else {
-      RFlowey::pair<TimeUtil::DateTime, RFlowey::pair<hash_t, Station_idx_t> > map_key_to_insert = {
-        date, {train.train_hash, current_s_idx}
-      };
-      daily_seat.insert(map_key_to_insert, train.seat_num);
-    }
+  auto record = daily_seat.get_ref(seat_index(train, date));
+  for (Station_idx_t i = seg.second.first; i < seg.second.second; ++i) {
+    record->seat[i] -= num_tickets;
   }
-
-  daily_seat.range_modify(key_start, key_end, [&](int &seat_val) {
-    seat_val -= num_tickets;
-  });
-
   return true;
 }
 
@@ -112,33 +109,21 @@ bool TrainManager::add_seat(const TrainData &train,
                             Segment_t seg,
                             const TimeUtil::DateTime &date,
                             int num_tickets) {
-  auto from_idx = seg.second.first;
-  auto to_idx = seg.second.second;
-  auto key_start = RFlowey::pair<TimeUtil::DateTime, RFlowey::pair<hash_t, Station_idx_t> >{
-    date, {train.train_hash, from_idx}
-  };
-  auto key_end = RFlowey::pair<TimeUtil::DateTime, RFlowey::pair<hash_t, Station_idx_t> >{
-    date, {train.train_hash, static_cast<Station_idx_t>(to_idx - 1)}
-  };
-
-  int modify_cnt = 0;
-  daily_seat.range_modify(key_start, key_end, [&](int &seat_val) {
-    int new_seat_num = seat_val + num_tickets;
-    if (new_seat_num > train.seat_num) {
+  auto record = daily_seat.get_ref(seat_index(train, date));
+  for (Station_idx_t i = seg.second.first; i < seg.second.second; ++i) {
+    if (std::as_const(record)->seat[i] + num_tickets > static_cast<int>(train.seat_num)) {
       throw std::runtime_error("Seat num exceed limit");
     }
-    seat_val = new_seat_num;
-    modify_cnt++;
-  });
-  if (modify_cnt != (to_idx - from_idx)) {
-    throw std::runtime_error("Modify cnt not match, data corrupted");
+  }
+  for (Station_idx_t i = seg.second.first; i < seg.second.second; ++i) {
+    record->seat[i] += num_tickets;
   }
   return true;
 }
 
 std::string TrainManager::query_train(const std::string &train_id_str, const std::string &date_str) {
   TrainID_t train_id_key(train_id_str.c_str());
-  auto train_data_opt = train_data_map_.find(train_id_key);
+  auto train_data_opt = find_train(train_id_key);
   if (!train_data_opt) {
     return "-1\n";
   }
@@ -150,17 +135,13 @@ std::string TrainManager::query_train(const std::string &train_id_str, const std
   std::ostringstream oss;
   oss << std::string(train.train_id.c_str()) << " " << train.type << "\n";
 
-  TimeUtil::DateTime current_event_time = date;
-  current_event_time = current_event_time + train.start_time;
-
-  long long cumulative_price = 0;
-
-  auto seat_result = daily_seat.find_range({date, {train.train_hash, 0}},
-                                           {date, {train.train_hash, train.station_num - 1}});
-  sjtu::vector<int> final_seat;
-  final_seat.resize(train.station_num - 1, train.seat_num);
-  for (auto &s: seat_result) {
-    final_seat[s.first.second.second] = s.second;
+  DailySeat final_seat;
+  if (train.release) {
+    final_seat = *daily_seat.get_const_ref(seat_index(train, date));
+  } else {
+    for (int i = 0; i + 1 < train.station_num; ++i) {
+      final_seat.seat[i] = static_cast<int>(train.seat_num);
+    }
   }
   for (size_t i = 0; i < train.station_num; ++i) {
     std::string station_name_str = "UNKNOWN_STATION";
@@ -173,33 +154,22 @@ std::string TrainManager::query_train(const std::string &train_id_str, const std
 
     std::string arrival_time_output_str;
     std::string leaving_time_output_str;
-    std::string price_output_str;
+    std::string price_output_str = std::to_string(train.price_sum[i]);
     std::string seat_output_str;
     if (i == 0) {
       arrival_time_output_str = "xx-xx xx:xx";
-      leaving_time_output_str = current_event_time.getFullString();
-      price_output_str = "0";
-      seat_output_str = std::to_string(final_seat[i]);
     } else {
-      arrival_time_output_str = current_event_time.getFullString();
-      cumulative_price += train.prices[i - 1];
-      price_output_str = std::to_string(cumulative_price);
-
-      if (i == train.station_num - 1) {
-        seat_output_str = "x";
-        leaving_time_output_str = "xx-xx xx:xx";
-      } else {
-        seat_output_str = std::to_string(final_seat[i]);
-        current_event_time = current_event_time + train.stopover_times[i - 1];
-        leaving_time_output_str = current_event_time.getFullString();
-      }
+      arrival_time_output_str = (date + train.arrive_times[i]).getFullString();
+    }
+    if (i == train.station_num - 1) {
+      seat_output_str = "x";
+      leaving_time_output_str = "xx-xx xx:xx";
+    } else {
+      seat_output_str = std::to_string(final_seat.seat[i]);
+      leaving_time_output_str = (date + train.leave_times[i]).getFullString();
     }
     oss << station_name_str << " " << arrival_time_output_str << " -> " << leaving_time_output_str << " " <<
         price_output_str << " " << seat_output_str << "\n";
-
-    if (i < train.station_num - 1) {
-      current_event_time = current_event_time + train.travel_times[i];
-    }
   }
   return oss.str();
 }
@@ -208,23 +178,55 @@ std::string TrainManager::query_train(const std::string &train_id_str, const std
 // In train.h, within TrainManager class or as a private helper struct
 
 
-sjtu::vector<TrainManager::BaseTrainInfo> TrainManager::get_train_in_segment(RFlowey::pair<int, int> station_pair_key) {
-  sjtu::vector<TrainManager::BaseTrainInfo> base_infos;
-  auto segments_on_route = seg_to_train_.find(station_pair_key);
-
-  for (const auto &seg_info: segments_on_route) {
-    // seg_info is Segment_t: {train_hash, {idx_from, idx_to}}
-    hash_t current_train_hash = seg_info.first;
-    auto train_data_opt = train_data_map_.find_by_hash(current_train_hash);
+sjtu::vector<StationStop> TrainManager::get_station_stops(int station_id) {
+  sjtu::vector<StationStop> stops;
+  for (auto it = station_to_train_.seek(station_id); it.valid() && it.key().first == station_id; it.next()) {
+    stops.push_back(it.key().second);
+  }
+  return stops;
+}
 
-    if (train_data_opt && train_data_opt.value().release) {
-      base_infos.push_back({train_data_opt.value(), seg_info, {}});
+sjtu::vector<RFlowey::pair<int, TrainManager::BaseTrainInfo> > TrainManager::get_train_through_station(
+  int station_id, bool downstream, const StationReach::Bitset &stations) {
+  struct Reach {
+    int station;
+    Segment_t seg;
+    size_t train;//index into trains
+  };
+  sjtu::vector<TrainData> trains;
+  sjtu::vector<Reach> reaches;
+  for (const auto &stop: get_station_stops(station_id)) {
+    auto train_data_opt = find_train(stop.train_hash);
+    if (!train_data_opt || !train_data_opt.value().release) {
+      continue;
+    }
+    const TrainData &train = train_data_opt.value();
+    Station_idx_t begin = downstream ? stop.idx + 1 : 0;
+    Station_idx_t end = downstream ? train.station_num : stop.idx;
+    size_t reach_count = reaches.size();
+    for (Station_idx_t k = begin; k < end; ++k) {
+      if (!StationReach::test(stations, train.stations[k])) {
+        continue;
+      }
+      Segment_t seg = downstream ? Segment_t{stop.train_hash, {stop.idx, k}} : Segment_t{stop.train_hash, {k, stop.idx}};
+      reaches.push_back({train.stations[k], seg, trains.size()});
     }
+    if (reaches.size() != reach_count) {
+      trains.push_back(train);
+    }
+  }
+  RFlowey::quick_sort(reaches.begin(), reaches.end(), [](const Reach &a, const Reach &b) {
+    if (a.station != b.station) return a.station < b.station;
+    return a.seg < b.seg;
+  });
+
+  sjtu::vector<RFlowey::pair<int, TrainManager::BaseTrainInfo> > base_infos;
+  for (const auto &reach: reaches) {
+    base_infos.push_back({reach.station, {trains[reach.train], reach.seg, {}}});
   }
   return base_infos;
 }
 
-
 void TrainManager::determine_date(sjtu::vector<TrainManager::BaseTrainInfo> &base, TimeUtil::DateTime min_depart_time) {
   for (auto &base_data: base) {
     TrainData &train = base_data.train;
@@ -286,10 +288,51 @@ sjtu::vector<QueryTicketInfo> TrainManager::process_output(sjtu::vector<TrainMan
 
 
 sjtu::vector<QueryTicketInfo> TrainManager::find_direct(RFlowey::pair<int, int> seg_key, TimeUtil::DateTime depart_date) {
-  auto base = get_train_in_segment(seg_key);
-  determine_date(base, depart_date);
-  filter_valid_date(base);
-  return process_output(base);
+  sjtu::vector<QueryTicketInfo> found_tickets;
+  auto from_stops = get_station_stops(seg_key.first);
+  auto to_stops = get_station_stops(seg_key.second);
+  const std::string &from_name = station_id_to_name_vec.at(seg_key.first);
+  const std::string &to_name = station_id_to_name_vec.at(seg_key.second);
+
+  //both lists are sorted by train hash, a train stops at a station at most once
+  size_t i = 0, j = 0;
+  while (i < from_stops.size() && j < to_stops.size()) {
+    if (from_stops[i].train_hash < to_stops[j].train_hash) {
+      ++i;
+      continue;
+    }
+    if (to_stops[j].train_hash < from_stops[i].train_hash) {
+      ++j;
+      continue;
+    }
+    const StationStop &from = from_stops[i++];
+    const StationStop &to = to_stops[j++];
+    if (from.idx >= to.idx) {
+      continue;
+    }
+    TimeUtil::DateTime original_date = (depart_date - from.leave).roundUpToDate();
+    if (!(from.sale_start <= original_date && original_date <= from.sale_end)) {
+      continue;
+    }
+
+    //only the trains left after filtering are loaded, for their id and seats
+    auto train_data_opt = find_train(from.train_hash);
+    if (!train_data_opt) {
+      continue;
+    }
+    const TrainData &train = train_data_opt.value();
+    int seats = query_seat(train, Segment_t{from.train_hash, {from.idx, to.idx}}, original_date);
+    found_tickets.push_back({
+      std::string(train.train_id.c_str()),
+      from_name,
+      original_date + from.leave,
+      to_name, original_date + to.arrive,
+      to.price - from.price,
+      seats,
+      to.arrive - from.leave
+    });
+  }
+  return found_tickets;
 }
 
 std::string TrainManager::query_ticket(const std::string &from_station_str, const std::string &to_station_str,
@@ -396,29 +439,80 @@ std::string TrainManager::query_transfer(const std::string &from_station_str, co
   auto to_id = res_to.value();
   TimeUtil::DateTime depart_datetime_from_s(date_str, "00:00");
 
-  OptimalTransfer best_transfer_solution;
-
-  for (int M_id = 0; M_id < next_station_id_val; ++M_id) {
-    if (M_id == from_id || M_id == to_id) {
-      continue;
+  //a transfer station is reached by some train from from_id and left by some train to to_id
+  if (!released_loaded_) {
+    load_released_trains();
+  }
+  auto candidates = station_reach_.transfer_candidates(from_id, to_id);
+  if (!StationReach::any(candidates)) {
+    return "0\n";
+  }
+  auto leaving = get_train_through_station(from_id, true, candidates);
+  auto arriving = get_train_through_station(to_id, false, candidates);
+  struct TransferStation {
+    size_t leg1_begin, leg1_end;
+    size_t leg2_begin, leg2_end;
+  };
+  sjtu::vector<TransferStation> transfer_stations;
+  size_t leg1_pos = 0, leg2_pos = 0;
+  while (leg1_pos < leaving.size() && leg2_pos < arriving.size()) {
+    int M_id = std::min(leaving[leg1_pos].first, arriving[leg2_pos].first);
+    TransferStation station{leg1_pos, leg1_pos, leg2_pos, leg2_pos};
+    while (station.leg1_end < leaving.size() && leaving[station.leg1_end].first == M_id) {
+      ++station.leg1_end;
     }
+    while (station.leg2_end < arriving.size() && arriving[station.leg2_end].first == M_id) {
+      ++station.leg2_end;
+    }
+    leg1_pos = station.leg1_end;
+    leg2_pos = station.leg2_end;
+    if (station.leg1_begin != station.leg1_end && station.leg2_begin != station.leg2_end) {
+      transfer_stations.push_back(station);
+    }
+  }
+
+  //stations are cut into consecutive chunks, each with its own best; folding the chunks in order
+  //keeps the first of equally good answers, as a sequential scan would
+  size_t chunk_num = std::min(transfer_stations.size(), (transfer_pool_.size() + 1) * 4);
+  sjtu::vector<OptimalTransfer> chunk_best;
+  chunk_best.resize(chunk_num);
+  transfer_pool_.parallel_for(chunk_num, [&](size_t chunk) {
+    size_t chunk_begin = transfer_stations.size() * chunk / chunk_num;
+    size_t chunk_end = transfer_stations.size() * (chunk + 1) / chunk_num;
+    OptimalTransfer &best = chunk_best[chunk];
+    for (size_t k = chunk_begin; k < chunk_end; ++k) {
+      const TransferStation &station = transfer_stations[k];
+      sjtu::vector<TrainManager::BaseTrainInfo> base1;
+      sjtu::vector<TrainManager::BaseTrainInfo> base2_temp;
+      for (size_t i = station.leg1_begin; i < station.leg1_end; ++i) {
+        base1.push_back(leaving[i].second);
+      }
+      for (size_t i = station.leg2_begin; i < station.leg2_end; ++i) {
+        base2_temp.push_back(arriving[i].second);
+      }
 
-    sjtu::vector<TrainManager::BaseTrainInfo> base1 = get_train_in_segment({from_id, M_id});
-    sjtu::vector<TrainManager::BaseTrainInfo> base2_temp = get_train_in_segment({M_id, to_id});
-    determine_date(base1, depart_datetime_from_s);
-    filter_valid_date(base1);
-    sjtu::vector<QueryTicketInfo> leg1_tickets = process_output(base1);
-
-    for (const auto & ticket1 : leg1_tickets) {
-      TimeUtil::DateTime earliest_depart_time_leg2_from_M = ticket1.at;
-      sjtu::vector<TrainManager::BaseTrainInfo> base2 = base2_temp;
-      determine_date(base2, earliest_depart_time_leg2_from_M);
-      filter_best_date(base2);
-      sjtu::vector<QueryTicketInfo> leg2_tickets = process_output(base2);
-      for (const auto & ticket2 : leg2_tickets) {
-        best_transfer_solution.update_if_better(ticket1, ticket2, sort_preference_str);
+      determine_date(base1, depart_datetime_from_s);
+      filter_valid_date(base1);
+      sjtu::vector<QueryTicketInfo> leg1_tickets = process_output(base1);
+
+      for (const auto & ticket1 : leg1_tickets) {
+        TimeUtil::DateTime earliest_depart_time_leg2_from_M = ticket1.at;
+        sjtu::vector<TrainManager::BaseTrainInfo> base2 = base2_temp;
+        determine_date(base2, earliest_depart_time_leg2_from_M);
+        filter_best_date(base2);
+        sjtu::vector<QueryTicketInfo> leg2_tickets = process_output(base2);
+        for (const auto & ticket2 : leg2_tickets) {
+          best.update_if_better(ticket1, ticket2, sort_preference_str);
+        }
       }
     }
+  });
+
+  OptimalTransfer best_transfer_solution;
+  for (const auto &best: chunk_best) {
+    if (best.found) {
+      best_transfer_solution.update_if_better(best.leg1_ticket, best.leg2_ticket, sort_preference_str);
+    }
   }
 
   if (best_transfer_solution.found) {
@@ -431,6 +525,57 @@ std::string TrainManager::query_transfer(const std::string &from_station_str, co
   }
 }
 
+void TrainManager::load_released_trains() {
+  route_planner_.clear();
+  station_reach_.clear();
+  for (auto it = train_data_map_.scan(); it.valid(); it.next()) {
+    if (it.value().release) {
+      route_planner_.add_train(it.value());
+      station_reach_.add_train(it.value());
+    }
+  }
+  released_loaded_ = true;
+}
+
+std::string TrainManager::query_route(const std::string &from_station_str, const std::string &to_station_str,
+                                      const std::string &date_str, const std::string &sort_preference_str,
+                                      const std::string &max_transfers_str) {
+  auto res_from = station_name_to_id(from_station_str);
+  auto res_to = station_name_to_id(to_station_str);
+  if (!res_from || !res_to) {
+    return "0\n";
+  }
+  int max_transfers = max_transfers_str.empty() ? ROUTE_DEFAULT_TRANSFERS : std::stoi(max_transfers_str);
+  TimeUtil::DateTime depart_date(date_str);
+  if (max_transfers < 0 || !depart_date.isValid()) {
+    return "0\n";
+  }
+  if (!released_loaded_) {
+    load_released_trains();
+  }
+
+  auto legs = route_planner_.plan(res_from.value(), res_to.value(), depart_date, max_transfers,
+                                  sort_preference_str == "cost");
+  std::ostringstream oss;
+  oss << legs.size() << "\n";
+  for (const auto &leg: legs) {
+    const TrainData &train = route_planner_.train(leg.train);
+    Segment_t seg{train.train_hash, {leg.from_idx, leg.to_idx}};
+    QueryTicketInfo ticket{
+      std::string(train.train_id.c_str()),
+      station_id_to_name_vec.at(train.stations[leg.from_idx]),
+      leg.original_date + train.get_leave_time(leg.from_idx),
+      station_id_to_name_vec.at(train.stations[leg.to_idx]),
+      leg.original_date + train.get_arrive_time(leg.to_idx),
+      train.price_between(leg.from_idx, leg.to_idx),
+      query_seat(train, seg, leg.original_date),
+      train.time_between(leg.from_idx, leg.to_idx)
+    };
+    oss << ticket.format() << '\n';
+  }
+  return oss.str();
+}
+
 // In train.cpp
 
 std::string TrainManager::buy_ticket(
@@ -459,7 +604,7 @@ std::string TrainManager::buy_ticket(
 
   UsernameKey user_key(username_str);
 
-  auto train_data_opt = train_data_map_.find(train_id_key);
+  auto train_data_opt = find_train(train_id_key);
   if (!train_data_opt) return "-1";
   TrainData &train = train_data_opt.value();
   if (!train.release) return "-1";
@@ -525,7 +670,7 @@ void TrainManager::process_refunded_tickets(
   int num_refunded_tickets = std::stoi(num_tickets_str);
   if (num_refunded_tickets <= 0) return;
 
-  auto train_data_opt = train_data_map_.find(train_id_key);
+  auto train_data_opt = find_train(train_id_key);
   if (!train_data_opt) return;
   TrainData &train = train_data_opt.value();
 
@@ -557,41 +702,54 @@ void TrainManager::process_refunded_tickets(
 
   add_seat(train, refunded_segment, original_date, num_refunded_tickets);
 
+  //pending orders not sharing a segment with the refund were short of seats before and still are
   WaitlistKey wk_key = {train.train_hash, original_date};
-  sjtu::vector<WaitlistEntry> waitlist_entries = order_manager.get_wait_list(wk_key);
-
-  RFlowey::quick_sort(waitlist_entries.begin(), waitlist_entries.end(), WaitlistEntry::sortByTimestamp);
+  sjtu::vector<WaitlistEntry> waitlist_entries =
+      order_manager.get_wait_list(wk_key, segment_mask(refunded_from_idx, refunded_to_idx));
+  if (waitlist_entries.empty()) {
+    return;
+  }
 
+  auto record = daily_seat.get_ref(seat_index(train, original_date));
+  DailySeat seats = *std::as_const(record);
+  bool changed = false;
   for (const auto &wle: waitlist_entries) {
-    OrderKey pending_order_key = {wle.user_hash, wle.command_ts};
-
-    Segment_t pending_journey_segment = {
-      wk_key.first, {wle.start_idx, wle.end_idx}
-    };
-
-    int seats_needed_for_pending = wle.num_tickets_needed;
-    int current_seats_for_pending_journey = query_seat(train, pending_journey_segment, wk_key.second);
-
-    if (current_seats_for_pending_journey >= seats_needed_for_pending) {
-      reduce_seat(train, pending_journey_segment, wk_key.second, seats_needed_for_pending);
-      order_manager.update_order_status(pending_order_key, OrderStatus::SUCCESS);
+    int available = static_cast<int>(train.seat_num);
+    for (int i = wle.start_idx; i < wle.end_idx; ++i) {
+      available = std::min(available, seats.seat[i]);
+    }
+    if (available >= wle.num_tickets_needed) {
+      for (int i = wle.start_idx; i < wle.end_idx; ++i) {
+        seats.seat[i] -= wle.num_tickets_needed;
+      }
+      changed = true;
+      order_manager.update_order_status({wle.user_hash, wle.command_ts}, OrderStatus::SUCCESS);
       order_manager.remove_from_waitlist(wk_key, wle);
     }
   }
+  if (changed) {
+    *record = seats;
+  }
+}
+
+std::string TrainManager::dump_id_name_mapping() {
+  std::string bytes(reinterpret_cast<const char*>(&next_station_id_val), sizeof(next_station_id_val));
+  size_t vec_size = station_id_to_name_vec.size();
+  bytes.append(reinterpret_cast<const char*>(&vec_size), sizeof(vec_size));
+  for (const auto& name : station_id_to_name_vec) {
+    size_t name_len = name.length();
+    bytes.append(reinterpret_cast<const char*>(&name_len), sizeof(name_len));
+    bytes.append(name);
+  }
+  return bytes;
 }
 
 void TrainManager::handle_exit() {
 
   std::ofstream ofs_vec(db_path_prefix + "_station_id_name.dat", std::ios::trunc | std::ios::binary);
   if (ofs_vec.is_open()) {
-    ofs_vec.write(reinterpret_cast<const char*>(&next_station_id_val), sizeof(next_station_id_val));
-    size_t vec_size = station_id_to_name_vec.size();
-    ofs_vec.write(reinterpret_cast<const char*>(&vec_size), sizeof(vec_size));
-    for (const auto& name : station_id_to_name_vec) {
-      size_t name_len = name.length();
-      ofs_vec.write(reinterpret_cast<const char*>(&name_len), sizeof(name_len));
-      ofs_vec.write(name.c_str(), name_len);
-    }
+    std::string bytes = dump_id_name_mapping();
+    ofs_vec.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
     ofs_vec.close();
   } else {
     std::cerr << "Failed to save station ID mapping for TrainManager." << std::endl;
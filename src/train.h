@@ -1,6 +1,7 @@
 #pragma once
 
 #include <map.hpp>
+#include <lru_cache.hpp>
 #include <string>
 #include <optional>
 #include <utility>
@@ -11,6 +12,7 @@
 #include "common.h"
 #include "my_fileconfig.h"
 #include "string_utils.h"
+#include "thread_pool.h"
 
 class OrderManager;
 
@@ -27,63 +29,59 @@ inline std::optional<int> station_name_to_id(const std::string& station_name) {
   return std::nullopt;
 }
 
+constexpr size_t TRAIN_CACHE_SIZE = 4096;//decoded TrainData kept in memory, about 2.5MB
+constexpr size_t TRANSFER_WORKERS = 3;//threads helping query_transfer besides the calling one, 0 runs it inline
+constexpr int ROUTE_DEFAULT_TRANSFERS = 2;//query_route without -k
+
 using TrainID_t = RFlowey::string<21>;
 using Station_idx_t = unsigned short;
 using Segment_t = RFlowey::pair<hash_t, RFlowey::pair<Station_idx_t, Station_idx_t> >;
 
-struct StationPairHasher {
-  size_t operator()(const RFlowey::pair<int, int>& p) const {
-    return p.first*(1<<16)+p.second;
-  }
-};
-
 struct TrainData {
   TrainID_t train_id;
   hash_t train_hash;
   int station_num;
   int stations[25];
   size_t seat_num;
-  int prices[25];
+  int price_sum[25];//price from the first station to station i
   Time_t start_time;
-  int travel_times[25];
-  int stopover_times[25];
+  Time_t arrive_times[25];//minutes since 00:00 of the departure date, arrive_times[0] is start_time
+  Time_t leave_times[25];//leave_times[station_num - 1] is 0
   TimeUtil::DateTime sale_start;
   TimeUtil::DateTime sale_end;
   char type;
   bool release = false;
+  size_t seat_base = 0;//first DailySeat record, only set once released
 
+  /**
+   * @brief fill the prefix arrays from per-segment values
+   */
+  void build_timetable(const int *prices, const Time_t *travel_times, const Time_t *stopover_times) {
+    if (station_num < 2) {
+      return;
+    }
+    price_sum[0] = 0;
+    arrive_times[0] = start_time;
+    leave_times[0] = start_time;
+    for (int i = 1; i < station_num; ++i) {
+      price_sum[i] = price_sum[i - 1] + prices[i - 1];
+      arrive_times[i] = leave_times[i - 1] + travel_times[i - 1];
+      leave_times[i] = i == station_num - 1 ? 0 : arrive_times[i] + stopover_times[i - 1];
+    }
+  }
 
-  int price_between(int from_idx, int to_idx) {
+  int price_between(int from_idx, int to_idx) const {
     if (from_idx < 0 || to_idx >= station_num || from_idx >= to_idx) {
       return -1;
-    };
-
-    int total_price = 0;
-    for (int i = from_idx; i < to_idx; ++i) {
-      total_price += prices[i];
     }
-    return total_price;
+    return price_sum[to_idx] - price_sum[from_idx];
   }
 
-
-  Time_t time_between(int from_idx, int to_idx) {
+  Time_t time_between(int from_idx, int to_idx) const {
     if (from_idx < 0 || to_idx >= station_num || from_idx >= to_idx) {
       return -1;
     }
-    Time_t total_travel_time = 0;
-
-    for (int i = from_idx; i < to_idx; ++i) {
-      total_travel_time += travel_times[i];
-    }
-
-    if (station_num > 2) {
-      for (int i = from_idx; i < to_idx - 1; ++i) {
-        if (i < station_num - 2) {
-          total_travel_time += stopover_times[i];
-        }
-      }
-    };
-    return total_travel_time;
+    return arrive_times[to_idx] - leave_times[from_idx];
   }
 
   TimeUtil::DateTime get_original_date(int station_idx, TimeUtil::DateTime depart_time) {
@@ -97,32 +95,15 @@ struct TrainData {
     if (target_idx >= station_num) {
       return {};
     }
-    Time_t current_dt=start_time;
-    for (Station_idx_t i = 0; i < target_idx; ++i) {
-      current_dt = current_dt + travel_times[i];
-      if (i < target_idx - 1) {
-        if (station_num > 2 && i < station_num - 2) {
-          current_dt = current_dt + stopover_times[i];
-        }
-      }
-    }
-    return current_dt;
+    return arrive_times[target_idx];
   }
 
   //Get the depart time since the original **Date**
   Time_t get_leave_time(Station_idx_t target_idx) const {
-    if (target_idx >= station_num || target_idx == station_num - 1) {
+    if (target_idx >= station_num) {
       return {};
     }
-    Time_t arrival_at_target = get_arrive_time(target_idx);
-    if (target_idx == 0) {
-      return arrival_at_target;
-    }
-    Time_t leave_dt = arrival_at_target;
-    if (station_num > 2) {
-      leave_dt = leave_dt + stopover_times[target_idx - 1];
-    }
-    return leave_dt;
+    return leave_times[target_idx];
   }
 
   bool verify_date(TimeUtil::DateTime original_date) {
@@ -174,6 +155,9 @@ struct TrainData {
       }
     }
 
+    int prices[25] = {};
+    Time_t travel_times[25] = {};
+    Time_t stopover_times[25] = {};
     size_t num_prices = station_num - 1;
     sjtu::vector<std::string> price_strs = split(p_prices_str, '|');
     for (size_t i = 0; i < num_prices; ++i) {
@@ -194,6 +178,7 @@ struct TrainData {
         stopover_times[i] = static_cast<Time_t>(std::stoll(stopover_time_strs[i]));
       }
     }
+    build_timetable(prices, travel_times, stopover_times);
     sjtu::vector<std::string> sale_date_parts = split(d_saleDate_str, '|');
     sale_start = TimeUtil::DateTime(sale_date_parts[0], "00:00");
     sale_end = TimeUtil::DateTime(sale_date_parts[1], "23:59");
@@ -241,15 +226,208 @@ struct QueryTicketInfo {
 };
 
 
+/**
+ * Posting of a station: one train stopping there, with what query_ticket needs precomputed
+ * so that candidates are filtered without loading their TrainData.
+ * Ordered and compared by (train_hash, idx) only.
+ */
+struct StationStop {
+  hash_t train_hash;
+  Station_idx_t idx;//index of the station on that train
+  int price;//cumulative price from the first station
+  Time_t arrive;//minutes since 00:00 of the departure date of the train
+  Time_t leave;
+  TimeUtil::DateTime sale_start;
+  TimeUtil::DateTime sale_end;
+
+  StationStop() = default;
+  StationStop(const TrainData &train, Station_idx_t station_idx)
+    : train_hash(train.train_hash), idx(station_idx), price(train.price_sum[station_idx]),
+      arrive(train.get_arrive_time(station_idx)), leave(train.get_leave_time(station_idx)),
+      sale_start(train.sale_start), sale_end(train.sale_end) {
+  }
+
+  bool operator<(const StationStop &other) const {
+    if (train_hash != other.train_hash) return train_hash < other.train_hash;
+    return idx < other.idx;
+  }
+  bool operator==(const StationStop &other) const {
+    return train_hash == other.train_hash && idx == other.idx;
+  }
+};
+
+/**
+ * Remaining seats of every segment of one train on one sale date.
+ * A released train owns one record per sale date, starting at TrainData::seat_base.
+ */
+struct DailySeat {
+  int seat[24];
+};
+
+/**
+ * Reachability between stations over the released trains, one bitset over station ids per station:
+ * forward[s] holds every station some train reaches after stopping at s, backward[s] every station
+ * some train stops at before reaching s.
+ */
+class StationReach {
+public:
+  using Bitset = sjtu::vector<unsigned long long>;
+
+private:
+  sjtu::vector<Bitset> forward_;
+  sjtu::vector<Bitset> backward_;
+
+  static void set(sjtu::vector<Bitset> &rows, int row, int station) {
+    if (row >= static_cast<int>(rows.size())) {
+      rows.resize(row + 1);
+    }
+    Bitset &bits = rows[row];
+    size_t word = station / 64;
+    if (word >= bits.size()) {
+      bits.resize(word + 1, 0);
+    }
+    bits[word] |= 1ULL << (station % 64);
+  }
+
+public:
+  void add_train(const TrainData &train) {
+    for (int i = 0; i < train.station_num; ++i) {
+      for (int j = i + 1; j < train.station_num; ++j) {
+        set(forward_, train.stations[i], train.stations[j]);
+        set(backward_, train.stations[j], train.stations[i]);
+      }
+    }
+  }
+
+  void clear() {
+    forward_.clear();
+    backward_.clear();
+  }
+
+  /**
+   * @brief stations where a journey from `from` can change to a train reaching `to`: forward[from] & backward[to]
+   */
+  [[nodiscard]] Bitset transfer_candidates(int from, int to) const {
+    Bitset result;
+    if (from >= static_cast<int>(forward_.size()) || to >= static_cast<int>(backward_.size())) {
+      return result;
+    }
+    const Bitset &a = forward_[from];
+    const Bitset &b = backward_[to];
+    size_t words = a.size() < b.size() ? a.size() : b.size();
+    result.resize(words, 0);
+    for (size_t i = 0; i < words; ++i) {
+      result[i] = a[i] & b[i];
+    }
+    return result;
+  }
+
+  static bool test(const Bitset &bits, int station) {
+    size_t word = station / 64;
+    return word < bits.size() && (bits[word] >> (station % 64) & 1);
+  }
+
+  static bool any(const Bitset &bits) {
+    for (size_t i = 0; i < bits.size(); ++i) {
+      if (bits[i]) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+/**
+ * In-memory timetable of the released trains, answering multi-leg queries with a round-based (RAPTOR) scan.
+ * Round r extends the itineraries found in round r - 1 by one more train, and only the trains stopping
+ * at a station improved in the previous round are scanned. Every station keeps the Pareto set of
+ * (arrival, price) labels reached so far, so both orders are answered by the same scan.
+ */
+class RoutePlanner {
+public:
+  struct Leg {
+    size_t train;//index for train()
+    Station_idx_t from_idx;
+    Station_idx_t to_idx;
+    TimeUtil::DateTime original_date;
+  };
+
+private:
+  struct Label {
+    Time_t arrive;//raw minutes
+    int price;
+    int station;
+    int parent;//label the last train was boarded from, -1 for the origin
+    int train;//-1 for the origin
+    Station_idx_t board;
+    Station_idx_t alight;
+    Time_t date;//original date of the last train
+    int next_in_bag;
+    int next_marked;
+    bool alive;
+  };
+
+  sjtu::vector<TrainData> trains_;
+  sjtu::vector<sjtu::vector<RFlowey::pair<int, Station_idx_t> > > stops_at_;//per station: (train, idx)
+
+  //labels of the trains taken to reach `label`, the first train first
+  void collect_legs(const sjtu::vector<Label> &labels, const Label &label, sjtu::vector<const Label *> &legs) const;
+  /**
+   * @brief order of itineraries with the same arrival and price: fewer trains first, then leg by leg
+   * train ID, date, boarding and alighting stop, so the answer does not depend on the release order
+   */
+  bool precedes(const sjtu::vector<Label> &labels, const Label &a, const Label &b) const;
+  bool try_add(sjtu::vector<Label> &labels, sjtu::vector<int> &bag_head, const Label &label, int target) const;
+
+public:
+  void add_train(const TrainData &train);
+
+  void clear() {
+    trains_.clear();
+    stops_at_.clear();
+  }
+
+  [[nodiscard]] const TrainData &train(size_t index) const {
+    return trains_[index];
+  }
+
+  /**
+   * @brief best itinerary from `from` to `to` using at most max_transfers + 1 trains,
+   * the first of which leaves `from` on depart_date
+   * @param by_cost order by total price then arrival, otherwise by arrival then total price
+   * @return the legs in travel order, empty when nothing is reachable
+   */
+  sjtu::vector<Leg> plan(int from, int to, TimeUtil::DateTime depart_date, int max_transfers, bool by_cost) const;
+};
+
 class TrainManager {
   HashedSingleMap<TrainID_t, TrainData, RFlowey::hasher<21> > train_data_map_;
-  OrderedHashMap<RFlowey::pair<int, int>, Segment_t, StationPairHasher> seg_to_train_;
-  SingleMap<RFlowey::pair<TimeUtil::DateTime,RFlowey::pair<hash_t, Station_idx_t>>, int> daily_seat;
+  RFlowey::LRUCache<hash_t, TrainData> train_cache_{TRAIN_CACHE_SIZE};
+  ThreadPool transfer_pool_{TRANSFER_WORKERS};
+  OrderedMultiMap<int, StationStop> station_to_train_;
+  RFlowey::PagedArray<DailySeat> daily_seat;
+  RoutePlanner route_planner_;
+  StationReach station_reach_;
+  //route_planner_ and station_reach_ are filled on the first query needing them, then kept up by release_train
+  bool released_loaded_ = false;
+
+  size_t seat_index(const TrainData &train, const TimeUtil::DateTime &date) const {
+    return train.seat_base + (date - train.sale_start) / TimeUtil::MINUTES_IN_DAY;
+  }
 
   hash_t hashSeg(const std::string &station1, const std::string &station2) {
     return norb::hash::djb2_hash(station1) + norb::hash::djb2_hash(station2);
   }
 
+  /**
+   * @brief read a train through train_cache_, the cache is refreshed by release_train and
+   * invalidated by delete_train and clean_data
+   */
+  std::optional<TrainData> find_train(hash_t train_hash);
+  std::optional<TrainData> find_train(const TrainID_t &train_id) {
+    return find_train(train_data_map_.hash_func(train_id));
+  }
+
   int query_seat(const TrainData &train, Segment_t seg, TimeUtil::DateTime date);
 
   bool reduce_seat(const TrainData &train, Segment_t seg, const TimeUtil::DateTime &date, int num_tickets);
@@ -263,7 +441,18 @@ class TrainManager {
   };
 
 
-  sjtu::vector<TrainManager::BaseTrainInfo> get_train_in_segment(RFlowey::pair<int, int> station_pair_key);
+  /**
+   * @brief posting list of station_id, sorted by train hash
+   */
+  sjtu::vector<StationStop> get_station_stops(int station_id);
+
+  /**
+   * @brief every released train stopping at station_id, paired with each later (downstream) or
+   * earlier station it stops at, as long as that station is in `stations`
+   * @return sorted by that other station, then by segment; each train is loaded only once
+   */
+  sjtu::vector<RFlowey::pair<int, TrainManager::BaseTrainInfo> > get_train_through_station(
+    int station_id, bool downstream, const StationReach::Bitset &stations);
 
   void determine_date(sjtu::vector<TrainManager::BaseTrainInfo>& base,TimeUtil::DateTime min_depart_time);
   sjtu::vector<QueryTicketInfo> process_output(sjtu::vector<TrainManager::BaseTrainInfo>& base);
@@ -272,15 +461,17 @@ class TrainManager {
 
   sjtu::vector<QueryTicketInfo> find_direct(RFlowey::pair<int, int> seg_key, TimeUtil::DateTime depart_date);
 
+  void load_released_trains();
+
 
 
 
 public:
   constexpr static std::string db_path_prefix = "train_data";
 
-  TrainManager();
+  explicit TrainManager(RFlowey::Tablespace &space);
 
-  ~TrainManager() = default;
+  ~TrainManager();
 
 
   /**
@@ -373,6 +564,25 @@ public:
     const std::string &sort_preference_str
   );
 
+  /**
+   * @brief Queries the best journey using up to k transfers between two stations.
+   * Corresponds to the 'query_route' command.
+   * @param from_station_str Departure station name (-s).
+   * @param to_station_str Arrival station name (-t).
+   * @param date_str Date of departure from the 'from_station_str' (mm-dd) for the first leg of the journey (-d).
+   * @param sort_preference_str "time" for the earliest arrival or "cost" for the lowest total price (-p).
+   * @param max_transfers_str Maximum number of transfers (-k), ROUTE_DEFAULT_TRANSFERS if empty.
+   * @return The number of legs on the first line, then one line per leg in the query_ticket format.
+   *         Returns "0" if no journey exists.
+   */
+  std::string query_route(
+    const std::string &from_station_str,
+    const std::string &to_station_str,
+    const std::string &date_str,
+    const std::string &sort_preference_str,
+    const std::string &max_transfers_str
+  );
+
   std::optional<std::pair<Station_idx_t, Station_idx_t>> find_station_indices(
       const TrainData &train, int from_station_id, int to_station_id);
 
@@ -402,15 +612,24 @@ public:
 
   void handle_exit();
 
+  //content of the station id/name file, also logged by the WAL whenever it changes
+  static std::string dump_id_name_mapping();
   void load_id_name_mapping();
   void clean_data() {
     station_name_to_id_map.clear();
     station_id_to_name_vec.clear();
     next_station_id_val = 0;
     train_data_map_.clear();
-    seg_to_train_.clear();
+    train_cache_.clear();
+    station_to_train_.clear();
     daily_seat.clear();
+    route_planner_.clear();
+    station_reach_.clear();
   };
+
+  [[nodiscard]] const BloomStats &filter_stats() const {
+    return train_data_map_.filter.stats();
+  }
 private:
 
 
@@ -1,10 +1,11 @@
 #include "user.h"
 
-UserManager::UserManager(): user_data_map_(db_file_prefix+".dat") {
+UserManager::UserManager(RFlowey::Tablespace &space): user_data_map_(space, db_file_prefix),
+                                                     is_first_user(!user_data_map_.scan().valid()) {
 }
 
 int UserManager::addUser(const Username_t &current_username, const Username_t &new_username, const Password_t &password, const Name_t &name, const MailAddr_t &mail_addr, Privilege_t privilege) {
-  if(!is_first_user.val) {
+  if(!is_first_user) {
     auto result = getUserRecord(current_username);
     if(!result) {
       return -1;
@@ -25,7 +26,7 @@ int UserManager::addUser(const Username_t &current_username, const Username_t &n
   new_user.setMailAddr(mail_addr);
   new_user.privilege = privilege;
   user_data_map_.insert(new_username,new_user);
-  is_first_user.val = false;
+  is_first_user = false;
   return 0;
 }
 
@@ -112,7 +113,7 @@ void UserManager::handleSystemExit() {
 }
 
 void UserManager::cleanAllData() {
-  is_first_user.val = true;
+  is_first_user = true;
   user_data_map_.clear();
   online_users_map_.clear();
 }
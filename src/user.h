@@ -7,7 +7,6 @@
 #include "utils.h"
 #include "database.h"
 #include "common.h"
-#include "my_fileconfig.h"
 
 using Username_t = std::string;
 using Password_t = std::string;
@@ -43,7 +42,7 @@ struct UserData {
 
 class UserManager {
 public:
-    UserManager();
+    explicit UserManager(RFlowey::Tablespace &space);
     ~UserManager()=default;
 
     int addUser(const Username_t& current_username,
@@ -73,13 +72,17 @@ public:
 
     bool isUserLoggedIn(const Username_t& username_str);
 
+    [[nodiscard]] const BloomStats& filterStats() const {
+        return user_data_map_.filter.stats();
+    }
+
 private:
     constexpr static std::string db_file_prefix = "user_data";
 
     HashedSingleMap<UsernameKey, UserData, RFlowey::hasher<21>> user_data_map_;
     sjtu::map<RFlowey::hash_t,bool> online_users_map_;
 
-    RFlowey::FiledConfig::tracker_t_<bool> is_first_user = RFlowey::FiledConfig::track<bool>(true);
+    bool is_first_user;//no user stored yet, the next add_user needs no login; users are only removed by clean
 
     std::optional<UserData> getUserRecord(const Username_t& username_str);
 
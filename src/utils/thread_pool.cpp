@@ -0,0 +1,76 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(size_t worker_num) : workers_(new std::thread[worker_num]), worker_num_(worker_num) {
+  for (size_t i = 0; i < worker_num_; ++i) {
+    workers_[i] = std::thread([this] { worker_loop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (size_t i = 0; i < worker_num_; ++i) {
+    workers_[i].join();
+  }
+  delete[] workers_;
+}
+
+void ThreadPool::drain(std::unique_lock<std::mutex> &lock) {
+  while (next_index_ < job_size_) {
+    size_t index = next_index_++;
+    const auto *job = job_;
+    lock.unlock();
+    try {
+      (*job)(index);
+    } catch (...) {
+      lock.lock();
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+      next_index_ = job_size_;//skip what has not started yet
+      continue;
+    }
+    lock.lock();
+  }
+}
+
+void ThreadPool::worker_loop() {
+  size_t seen_generation = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    work_cv_.wait(lock, [&] { return stop_ || generation_ != seen_generation; });
+    if (stop_) {
+      return;
+    }
+    seen_generation = generation_;
+    ++running_;
+    drain(lock);
+    if (--running_ == 0) {
+      done_cv_.notify_all();
+    }
+  }
+}
+
+void ThreadPool::parallel_for(size_t n, const std::function<void(size_t)> &job) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_ = &job;
+  job_size_ = n;
+  next_index_ = 0;
+  error_ = nullptr;
+  ++generation_;
+  if (worker_num_ > 0 && n > 1) {
+    work_cv_.notify_all();
+  }
+  drain(lock);
+  done_cv_.wait(lock, [&] { return running_ == 0; });
+  job_ = nullptr;
+  job_size_ = 0;
+  if (error_) {
+    std::exception_ptr error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
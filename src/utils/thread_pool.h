@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Fixed set of worker threads running one parallel_for at a time.
+ * The calling thread takes part in the work, so a pool of 0 workers runs everything inline.
+ */
+class ThreadPool {
+  std::thread *workers_;//worker_num_ threads, started by the constructor
+  size_t worker_num_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+
+  //current job, guarded by mutex_
+  const std::function<void(size_t)> *job_ = nullptr;
+  size_t job_size_ = 0;
+  size_t next_index_ = 0;
+  size_t running_ = 0;//workers still inside the current job
+  size_t generation_ = 0;
+  std::exception_ptr error_;
+  bool stop_ = false;
+
+  void worker_loop();
+  //take indices until the job is exhausted, lock must hold mutex_
+  void drain(std::unique_lock<std::mutex> &lock);
+
+public:
+  explicit ThreadPool(size_t worker_num);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  [[nodiscard]] size_t size() const {
+    return worker_num_;
+  }
+
+  /**
+   * @brief run job(i) for every i in [0, n) and wait for all of them
+   * @throw the first exception thrown by a job, after every started job has returned
+   */
+  void parallel_for(size_t n, const std::function<void(size_t)> &job);
+};